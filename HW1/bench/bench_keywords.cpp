@@ -0,0 +1,103 @@
+// Keyword classification: the packed length switch (classifyWord) against the
+// std::unordered_map lookups it replaced, on identifier-heavy input.
+//
+//   bench_keywords [words] [rounds]
+
+#include "lexer/keywords.h"
+#include "lexer/lexer.h"
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+static const std::unordered_map<std::string, TokenType> stringKeywords = {
+    {"fn",     TokenType::KW_FN},
+    {"let",    TokenType::KW_LET},
+    {"mut",    TokenType::KW_MUT},
+    {"if",     TokenType::KW_IF},
+    {"else",   TokenType::KW_ELSE},
+    {"while",  TokenType::KW_WHILE},
+    {"return", TokenType::KW_RETURN},
+};
+
+static const std::unordered_map<std::string_view, TokenType> viewKeywords = {
+    {"fn",     TokenType::KW_FN},
+    {"let",    TokenType::KW_LET},
+    {"mut",    TokenType::KW_MUT},
+    {"if",     TokenType::KW_IF},
+    {"else",   TokenType::KW_ELSE},
+    {"while",  TokenType::KW_WHILE},
+    {"return", TokenType::KW_RETURN},
+};
+
+// Deterministic identifier-heavy corpus: ~20% keywords, the rest identifiers
+// of 1..12 characters, many of them sharing a prefix with a keyword.
+static std::string makeCorpus(size_t words) {
+    static const char* keywords[] = {"fn", "let", "mut", "if", "else", "while", "return"};
+    static const char* stems[] = {"f", "fnord", "le", "letter", "mu", "mutex", "iff",
+                                  "elsewhere", "whilst", "ret", "returned", "x", "count"};
+    static const char alnum[] = "abcdefghijklmnopqrstuvwxyz_0123456789";
+    uint32_t seed = 12345;
+    auto next = [&seed]() { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+
+    std::string out;
+    for (size_t i = 0; i < words; ++i) {
+        uint32_t r = next() % 10;
+        if (r < 2) {
+            out += keywords[next() % 7];
+        } else if (r < 5) {
+            out += stems[next() % 13];
+        } else {
+            size_t len = 1 + next() % 12;
+            out += static_cast<char>('a' + next() % 26);
+            for (size_t j = 1; j < len; ++j) out += alnum[next() % 37];
+        }
+        out += (i % 12 == 11) ? '\n' : ' ';
+    }
+    return out;
+}
+
+template <typename F>
+static double nsPerWord(const std::vector<std::string_view>& words, int rounds, F classify) {
+    uint64_t sink = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < rounds; ++r) {
+        for (std::string_view w : words) sink += static_cast<uint64_t>(classify(w));
+    }
+    auto end = std::chrono::steady_clock::now();
+    volatile uint64_t keep = sink;    // keep the loop alive
+    (void)keep;
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    return ns / (static_cast<double>(words.size()) * rounds);
+}
+
+int main(int argc, char* argv[]) {
+    size_t count = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 1000000;
+    int rounds = argc > 2 ? std::atoi(argv[2]) : 5;
+
+    std::string corpus = makeCorpus(count);
+    std::vector<std::string_view> words;
+    for (const Token& t : Lexer(corpus).tokenize()) {
+        if (t.type != TokenType::END_OF_FILE) words.push_back(t.lexeme);
+    }
+
+    double mapString = nsPerWord(words, rounds, [](std::string_view w) {
+        auto it = stringKeywords.find(std::string(w));
+        return it != stringKeywords.end() ? it->second : TokenType::IDENTIFIER;
+    });
+    double mapView = nsPerWord(words, rounds, [](std::string_view w) {
+        auto it = viewKeywords.find(w);
+        return it != viewKeywords.end() ? it->second : TokenType::IDENTIFIER;
+    });
+    double packed = nsPerWord(words, rounds, classifyWord);
+
+    std::cout << "words: " << words.size() << " x " << rounds << " rounds\n"
+              << "unordered_map<string>       " << mapString << " ns/word\n"
+              << "unordered_map<string_view>  " << mapView << " ns/word\n"
+              << "classifyWord                " << packed << " ns/word\n";
+    return 0;
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+// Measurement and reporting shared by the benchmark suites of HW1 and the
+// HW1_bystep parser. Each result is one JSON object per line:
+//
+//   {"suite":"hw1","bench":"lexer.tokenize","bytes":1048576,"seed":1,
+//    "seconds":0.0012,"mb_per_s":873.8,"tokens":240113,"tokens_per_s":2.0e8,
+//    "nodes":0,"nodes_per_s":0,"allocs":31,"allocs_per_token":0.00013}
+//
+// `seconds` is the best of the repetitions, and the rates are derived from
+// it and the input size; `allocs` counts operator new calls in one run.
+//
+// The allocation counter replaces the global operator new and delete, so
+// this header must be included by exactly one translation unit of a
+// benchmark binary.
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <string>
+
+namespace bench {
+
+inline std::atomic<uint64_t>& allocationCount() {
+    static std::atomic<uint64_t> count{0};
+    return count;
+}
+
+} // namespace bench
+
+void* operator new(std::size_t size) {
+    bench::allocationCount().fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size) { return operator new(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+
+namespace bench {
+
+struct Result {
+    const char* suite;
+    std::string bench;
+    size_t bytes = 0;       // input size
+    uint64_t seed = 0;
+    double seconds = 0;
+    size_t tokens = 0;
+    size_t nodes = 0;
+    uint64_t allocs = 0;
+};
+
+inline void report(const Result& r) {
+    double mb = r.seconds > 0 ? r.bytes / 1e6 / r.seconds : 0;
+    double tps = r.seconds > 0 ? r.tokens / r.seconds : 0;
+    double nps = r.seconds > 0 ? r.nodes / r.seconds : 0;
+    double apt = r.tokens ? static_cast<double>(r.allocs) / r.tokens : 0;
+    std::printf("{\"suite\":\"%s\",\"bench\":\"%s\",\"bytes\":%zu,\"seed\":%llu,\"seconds\":%.6g,"
+                "\"mb_per_s\":%.6g,\"tokens\":%zu,\"tokens_per_s\":%.6g,\"nodes\":%zu,\"nodes_per_s\":%.6g,"
+                "\"allocs\":%llu,\"allocs_per_token\":%.6g}\n",
+                r.suite, r.bench.c_str(), r.bytes, static_cast<unsigned long long>(r.seed), r.seconds, mb,
+                r.tokens, tps, r.nodes, nps, static_cast<unsigned long long>(r.allocs), apt);
+    std::fflush(stdout);
+}
+
+// Runs `body` `repeat` times and records the best time and the allocations
+// of the first run. `setup` runs untimed before every repetition.
+template <class Setup, class Body>
+void measure(Result& r, int repeat, Setup setup, Body body) {
+    r.seconds = 0;
+    for (int i = 0; i < repeat; ++i) {
+        setup();
+        uint64_t before = allocationCount().load(std::memory_order_relaxed);
+        auto start = std::chrono::steady_clock::now();
+        body();
+        auto end = std::chrono::steady_clock::now();
+        if (i == 0) r.allocs = allocationCount().load(std::memory_order_relaxed) - before;
+        double s = std::chrono::duration<double>(end - start).count();
+        if (i == 0 || s < r.seconds) r.seconds = s;
+    }
+}
+
+} // namespace bench
@@ -0,0 +1,67 @@
+// Lexing throughput on comment- and whitespace-heavy input, plus the raw
+// speed of each scan kernel implementation available on this CPU.
+//
+//   bench_scan [megabytes]
+
+#include "lexer/lexer.h"
+#include "lexer/scan.h"
+#include <chrono>
+#include <cstdlib>
+#include <initializer_list>
+#include <iostream>
+#include <string>
+
+static std::string makeCorpus(size_t bytes) {
+    std::string out;
+    uint32_t seed = 777;
+    auto next = [&seed]() { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+    while (out.size() < bytes) {
+        out += "    // ";
+        out.append(40 + next() % 60, 'c');
+        out += "\n\n";
+        out.append(4 * (1 + next() % 6), ' ');
+        out += "let value_" + std::to_string(next() % 1000) + " = \"";
+        out.append(10 + next() % 50, 's');
+        out += "\";\n";
+    }
+    return out;
+}
+
+template <typename F>
+static double mbPerSec(size_t bytes, F run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+    return bytes / 1e6 / std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char* argv[]) {
+    size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    std::string corpus = makeCorpus(mb << 20);
+    const char* d = corpus.data();
+    const size_t n = corpus.size();
+
+    for (const scan::Kernels* k : {&scan::scalar(), scan::sse2(), scan::avx2()}) {
+        if (!k) continue;
+        size_t sink = 0;
+        // Alternate blank runs and comment bodies the way skipWhitespace does
+        double rate = mbPerSec(n, [&] {
+            size_t pos = 0;
+            while (pos < n) {
+                pos = k->skipBlanks(d, pos, n);
+                pos = k->skipToNewline(d, pos, n) + 1;
+                sink += pos;
+            }
+        });
+        std::cout << "kernels " << k->name << ": " << rate << " MB/s" << (sink ? "" : " ") << "\n";
+    }
+
+    size_t tokens = 0;
+    double rate = mbPerSec(n, [&] {
+        Lexer lexer(corpus);
+        while (lexer.nextToken().type != TokenType::END_OF_FILE) tokens++;
+    });
+    std::cout << "Lexer::nextToken (" << scan::active().name << "): " << rate << " MB/s, "
+              << tokens << " tokens\n";
+    return 0;
+}
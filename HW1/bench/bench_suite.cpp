@@ -0,0 +1,66 @@
+// Throughput of the HW1 lexer on generated corpora, one JSON line per
+// measurement (see bench_report.h). `make bench` runs it with the default
+// sizes; the parser's suite in HW1_bystep/Parser/bench covers the rest of
+// the pipeline on the same corpora.
+//
+//   bench_suite [--sizes=1K,64K,1M,16M] [--repeat=N] [generator flags]
+//
+// Generator flags are listed in corpus_gen.h; sizes go up to 1G and beyond.
+
+#include "bench_report.h"
+#include "corpus_gen.h"
+#include "lexer/lexer.h"
+#include "lexer/token_buffer.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    bench::CorpusOptions options;
+    std::vector<size_t> sizes = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+    int repeat = 5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--sizes=") == 0) {
+            sizes.clear();
+            std::istringstream list(arg.substr(8));
+            for (std::string item; std::getline(list, item, ',');) {
+                size_t bytes;
+                if (!bench::parseSize(item, bytes)) {
+                    std::cerr << "Error: bad size '" << item << "'" << std::endl;
+                    return 1;
+                }
+                sizes.push_back(bytes);
+            }
+        } else if (arg.compare(0, 9, "--repeat=") == 0) {
+            repeat = std::max(1, std::atoi(arg.c_str() + 9));
+        } else if (!bench::parseCorpusFlag(arg, options)) {
+            std::cerr << "Usage: bench_suite [--sizes=LIST] [--repeat=N] [--seed=N] [--depth=N] "
+                         "[--statements=N] [--identifiers=P] [--strings=P] [--comments=P]" << std::endl;
+            return 1;
+        }
+    }
+
+    for (size_t size : sizes) {
+        std::string corpus;
+        bench::CorpusGenerator(options).appendUntil(corpus, size);
+
+        bench::Result r{"hw1", "lexer.tokenize"};
+        r.bytes = corpus.size();
+        r.seed = options.seed;
+        std::vector<Token> tokens;
+        bench::measure(r, repeat, [&] { std::vector<Token>().swap(tokens); },
+                       [&] { tokens = Lexer(corpus).tokenize(); });
+        r.tokens = tokens.size();
+        bench::report(r);
+
+        r.bench = "lexer.tokenize_buffer";
+        TokenBuffer buffer(corpus);
+        bench::measure(r, repeat, [&] { buffer = TokenBuffer(corpus); },
+                       [&] { Lexer(corpus).tokenize(buffer); });
+        r.tokens = buffer.size();
+        bench::report(r);
+    }
+    return 0;
+}
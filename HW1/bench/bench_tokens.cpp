@@ -0,0 +1,94 @@
+// Token storage: std::vector<Token> (24 bytes a token) against the
+// struct-of-arrays TokenBuffer (9 bytes a token plus a line table). Reports
+// the bytes each holds, the time to fill it, a lookahead-style pass that
+// only reads kinds, and a pass that needs every token's line:column (in
+// order through a hinted LineIndex, and by plain binary search).
+//
+//   bench_tokens [megabytes]
+
+#include "lexer/lexer.h"
+#include "lexer/line_index.h"
+#include "lexer/token_buffer.h"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static std::string makeCorpus(size_t bytes) {
+    std::string out;
+    uint32_t seed = 4242;
+    auto next = [&seed]() { seed = seed * 1103515245u + 12345u; return seed >> 8; };
+    while (out.size() < bytes) {
+        out += "fn f" + std::to_string(next() % 1000) + "(a: i32, b: i32) -> i32 {\n";
+        for (int i = 0, n = 2 + next() % 6; i < n; ++i) {
+            out += "    let mut v" + std::to_string(i) + " = a * " + std::to_string(next() % 100) +
+                   " + call(b, \"text\");\n";
+            if (next() % 3 == 0) out += "    // comment\n";
+        }
+        out += "    if a >= b { return a; } else { return v0; }\n}\n\n";
+    }
+    return out;
+}
+
+template <typename F>
+static double seconds(F run) {
+    auto start = std::chrono::steady_clock::now();
+    run();
+    auto end = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(end - start).count();
+}
+
+// What a parser's lookahead does most: is this a call (IDENTIFIER LPAREN)?
+template <class Kind>
+static size_t countCalls(size_t n, Kind kind) {
+    size_t calls = 0;
+    for (size_t i = 0; i + 1 < n; ++i) {
+        calls += kind(i) == TokenType::IDENTIFIER && kind(i + 1) == TokenType::LPAREN;
+    }
+    return calls;
+}
+
+static void report(const char* name, size_t bytes, size_t tokens, double fill, double kinds,
+                   double positions) {
+    std::cout << name << ": " << bytes / 1e6 << " MB (" << static_cast<double>(bytes) / tokens
+              << " bytes/token), fill " << fill * 1e3 << " ms, kinds pass " << kinds * 1e3
+              << " ms, line:column pass " << positions * 1e3 << " ms\n";
+}
+
+int main(int argc, char* argv[]) {
+    size_t mb = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 64;
+    std::string corpus = makeCorpus(mb << 20);
+    size_t sink = 0;
+
+    std::vector<Token> wide;
+    double fill = seconds([&] { wide = Lexer(corpus).tokenize(); });
+    double kinds = seconds([&] { sink += countCalls(wide.size(), [&](size_t i) { return wide[i].type; }); });
+    double positions = seconds([&] {
+        LineIndex lines(corpus);
+        size_t hint = 0;
+        for (const Token& t : wide) {
+            Position p = lines.locate(t, hint);
+            sink += static_cast<size_t>(p.line + p.column);
+        }
+    });
+    size_t wideBytes = wide.capacity() * sizeof(Token);
+    report("std::vector<Token>", wideBytes, wide.size(), fill, kinds, positions);
+    std::vector<Token>().swap(wide);
+
+    TokenBuffer compact(corpus);
+    fill = seconds([&] { Lexer(corpus).tokenize(compact); });
+    const TokenType* k = compact.kinds();
+    kinds = seconds([&] { sink += countCalls(compact.size(), [&](size_t i) { return k[i]; }); });
+    positions = seconds([&] {
+        for (size_t i = 0; i < compact.size(); ++i) {
+            Position p = compact.position(i);
+            sink += static_cast<size_t>(p.line + p.column);
+        }
+    });
+    report("TokenBuffer", compact.memoryBytes(), compact.size(), fill, kinds, positions);
+
+    std::cout << compact.size() << " tokens, " << static_cast<double>(wideBytes) / compact.memoryBytes()
+              << "x less memory" << (sink ? "" : " ") << "\n";
+    return 0;
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+// Deterministic generator of Rust-subset source text for the benchmarks.
+// The output uses only what the HW1_bystep parser accepts (functions
+// without parameters, let, if/else, while, return and binary expressions),
+// so both lexers and the parser see the same well-formed input. It depends
+// on nothing but the standard library and is shared with the parser's
+// benchmark suite; the same options and seed give the same bytes on every
+// platform.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace bench {
+
+struct CorpusOptions {
+    uint64_t seed = 1;
+    int depth = 3;                 // deepest if/while nesting inside a function
+    int statements = 5;            // average statements per block
+    double identifiers = 0.5;      // share of operands that are identifiers
+    double strings = 0.05;         // share of operands that are string literals
+    double comments = 0.1;         // chance of a comment line before a statement
+};
+
+class CorpusGenerator {
+public:
+    explicit CorpusGenerator(const CorpusOptions& options) : options_(options), state_(options.seed) {}
+
+    // Appends one top-level function
+    void appendFunction(std::string& out) {
+        out += "fn f";
+        out += std::to_string(functions_++);
+        out += "() {\n";
+        appendBlock(out, 1);
+        out += "}\n\n";
+    }
+
+    // Whole functions until `out` holds at least `bytes` bytes
+    void appendUntil(std::string& out, size_t bytes) {
+        while (out.size() < bytes) appendFunction(out);
+    }
+
+private:
+    CorpusOptions options_;
+    uint64_t state_;
+    uint64_t functions_ = 0;
+
+    // splitmix64: fixed arithmetic, unlike the <random> distributions
+    uint64_t next() {
+        uint64_t z = (state_ += 0x9E3779B97F4A7C15ull);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    uint64_t below(uint64_t bound) { return next() % bound; }
+    bool chance(double p) { return static_cast<double>(next() >> 11) * 0x1.0p-53 < p; }
+
+    void indent(std::string& out, int depth) { out.append(static_cast<size_t>(depth) * 4, ' '); }
+
+    void appendName(std::string& out) {
+        static const char* const stems[] = {"value", "count", "x", "total", "index", "left",
+                                            "right", "acc", "n", "tmp", "result", "item"};
+        out += stems[below(12)];
+        if (chance(0.7)) out += std::to_string(below(100));
+    }
+
+    void appendOperand(std::string& out) {
+        if (chance(options_.strings)) {
+            // No escaped quotes: the HW1 lexer ends a string at any '"'
+            static const char* const texts[] = {"hello", "two words", "path/to/file",
+                                                "x = 1; // not a comment", "", "tab\\tand\\nnewline"};
+            out += '"';
+            out += texts[below(6)];
+            out += '"';
+        } else if (chance(options_.identifiers)) {
+            appendName(out);
+        } else {
+            out += std::to_string(below(10000));
+        }
+    }
+
+    void appendExpression(std::string& out) {
+        static const char* const ops[] = {" + ", " - ", " * ", " / ", " == ", " != ",
+                                          " < ", " > ", " <= ", " >= "};
+        appendOperand(out);
+        for (uint64_t i = below(4); i > 0; --i) {
+            out += ops[below(10)];
+            appendOperand(out);
+        }
+    }
+
+    void appendBlock(std::string& out, int depth) {
+        int count = 1 + static_cast<int>(below(static_cast<uint64_t>(2 * options_.statements)));
+        for (int i = 0; i < count; ++i) {
+            if (chance(options_.comments)) {
+                indent(out, depth);
+                out += "// step ";
+                out += std::to_string(below(1000));
+                out += " of the computation\n";
+            }
+            appendStatement(out, depth, i + 1 == count);
+        }
+    }
+
+    void appendStatement(std::string& out, int depth, bool last) {
+        indent(out, depth);
+        uint64_t kind = below(10);
+        bool nest = depth <= options_.depth;
+        if (last && depth == 1) {
+            out += "return ";
+            appendExpression(out);
+            out += ";\n";
+        } else if (nest && kind < 2) {
+            out += "if ";
+            appendExpression(out);
+            out += " {\n";
+            appendBlock(out, depth + 1);
+            indent(out, depth);
+            if (chance(0.5)) {
+                out += "} else {\n";
+                appendBlock(out, depth + 1);
+                indent(out, depth);
+            }
+            out += "}\n";
+        } else if (nest && kind < 3) {
+            out += "while ";
+            appendExpression(out);
+            out += " {\n";
+            appendBlock(out, depth + 1);
+            indent(out, depth);
+            out += "}\n";
+        } else {
+            out += chance(0.3) ? "let mut " : "let ";
+            appendName(out);
+            out += " = ";
+            appendExpression(out);
+            out += ";\n";
+        }
+    }
+};
+
+// Applies a generator flag (--seed=, --depth=, --statements=, --identifiers=,
+// --strings=, --comments=). Returns false for anything else.
+inline bool parseCorpusFlag(const std::string& arg, CorpusOptions& options) {
+    auto value = [&](const char* name) -> const char* {
+        size_t n = std::string(name).size();
+        return arg.compare(0, n, name) == 0 ? arg.c_str() + n : nullptr;
+    };
+    if (const char* v = value("--seed=")) options.seed = std::strtoull(v, nullptr, 10);
+    else if (const char* v = value("--depth=")) options.depth = std::atoi(v);
+    else if (const char* v = value("--statements=")) options.statements = std::atoi(v) > 0 ? std::atoi(v) : 1;
+    else if (const char* v = value("--identifiers=")) options.identifiers = std::atof(v);
+    else if (const char* v = value("--strings=")) options.strings = std::atof(v);
+    else if (const char* v = value("--comments=")) options.comments = std::atof(v);
+    else return false;
+    return true;
+}
+
+// Parses sizes such as "4096", "64K", "16M" or "1G" (binary units)
+inline bool parseSize(const std::string& text, size_t& bytes) {
+    char* end = nullptr;
+    unsigned long long value = std::strtoull(text.c_str(), &end, 10);
+    if (end == text.c_str()) return false;
+    std::string unit = end;
+    int shift = unit.empty() ? 0 : unit == "K" ? 10 : unit == "M" ? 20 : unit == "G" ? 30 : -1;
+    if (shift < 0) return false;
+    bytes = static_cast<size_t>(value) << shift;
+    return true;
+}
+
+} // namespace bench
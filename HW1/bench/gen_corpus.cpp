@@ -0,0 +1,39 @@
+// Writes a generated corpus (see corpus_gen.h) to standard output.
+//
+//   gen_corpus SIZE [generator flags]      e.g. gen_corpus 1G --seed=7 > big.rs
+
+#include "corpus_gen.h"
+#include <iostream>
+#include <string>
+
+int main(int argc, char* argv[]) {
+    bench::CorpusOptions options;
+    size_t size = 0;
+    bool haveSize = false;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (bench::parseCorpusFlag(arg, options)) continue;
+        if (haveSize || !bench::parseSize(arg, size)) {
+            std::cerr << "Usage: gen_corpus SIZE [--seed=N] [--depth=N] [--statements=N] "
+                         "[--identifiers=P] [--strings=P] [--comments=P]" << std::endl;
+            return 1;
+        }
+        haveSize = true;
+    }
+
+    // Same bytes as appendUntil(size), written in blocks
+    bench::CorpusGenerator generator(options);
+    std::string block;
+    size_t written = 0;
+    while (written < size) {
+        size_t before = block.size();
+        generator.appendFunction(block);
+        written += block.size() - before;
+        if (block.size() >= (1 << 20) || written >= size) {
+            std::cout.write(block.data(), static_cast<std::streamsize>(block.size()));
+            block.clear();
+        }
+    }
+    std::cout.flush();
+    return 0;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "lexer/token.h"
+#include <cstdint>
+
+// The single definition of how the lexer treats each byte. `start` says what
+// kind of token (or skippable run) a byte begins; the flags drive the loops
+// that extend a token. Only ASCII letters, digits and '_' count as identifier
+// bytes, independent of the C locale.
+enum class CharClass : uint8_t {
+    Other,      // not part of the language: one-byte ERROR token
+    Blank,      // ' ', '\t', '\r', '\n'
+    Ident,      // [A-Za-z_]: identifier or keyword
+    Digit,      // [0-9]: integer literal
+    Quote,      // '"': string literal
+    Slash,      // '/': line comment or SLASH
+    Single,     // one-byte token, see CharInfo::token
+    OrEq,       // one-byte token that becomes CharInfo::withEq before '='
+    Count
+};
+
+enum : uint8_t {
+    kBlankChar = 1 << 0,
+    kIdentChar = 1 << 1,    // may continue an identifier
+    kDigitChar = 1 << 2,
+};
+
+struct CharInfo {
+    CharClass start;
+    TokenType token;
+    TokenType withEq;
+    uint8_t flags;
+};
+
+// Plain array rather than std::array so the table can be read from code built
+// for a different ISA (see scan_kernels.h) without instantiating any inline
+// member functions there.
+struct CharTable {
+    CharInfo entries[256];
+};
+
+constexpr CharTable makeCharTable() {
+    CharTable table{};
+    for (auto& info : table.entries) {
+        info = CharInfo{CharClass::Other, TokenType::ERROR, TokenType::ERROR, 0};
+    }
+    const char blanks[] = {' ', '\t', '\r', '\n'};
+    for (char c : blanks) {
+        table.entries[static_cast<unsigned char>(c)] = CharInfo{CharClass::Blank, TokenType::ERROR, TokenType::ERROR, kBlankChar};
+    }
+    for (int c = 0; c < 256; ++c) {
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') {
+            table.entries[c] = CharInfo{CharClass::Ident, TokenType::IDENTIFIER, TokenType::ERROR, kIdentChar};
+        } else if (c >= '0' && c <= '9') {
+            table.entries[c] = CharInfo{CharClass::Digit, TokenType::INTEGER, TokenType::ERROR, kIdentChar | kDigitChar};
+        }
+    }
+    table.entries['"'].start = CharClass::Quote;
+    table.entries['/'] = CharInfo{CharClass::Slash, TokenType::SLASH, TokenType::ERROR, 0};
+
+    struct { char c; TokenType type; } singles[] = {
+        {'(', TokenType::LPAREN}, {')', TokenType::RPAREN}, {'{', TokenType::LBRACE},
+        {'}', TokenType::RBRACE}, {';', TokenType::SEMICOLON}, {':', TokenType::COLON},
+        {',', TokenType::COMMA}, {'+', TokenType::PLUS}, {'-', TokenType::MINUS},
+        {'*', TokenType::STAR},
+    };
+    for (const auto& s : singles) {
+        table.entries[static_cast<unsigned char>(s.c)] = CharInfo{CharClass::Single, s.type, TokenType::ERROR, 0};
+    }
+
+    struct { char c; TokenType alone; TokenType withEq; } orEq[] = {
+        {'=', TokenType::ASSIGN, TokenType::EQ},
+        {'!', TokenType::ERROR,  TokenType::NEQ},
+        {'<', TokenType::LT,     TokenType::LTE},
+        {'>', TokenType::GT,     TokenType::GTE},
+    };
+    for (const auto& o : orEq) {
+        table.entries[static_cast<unsigned char>(o.c)] = CharInfo{CharClass::OrEq, o.alone, o.withEq, 0};
+    }
+    return table;
+}
+
+inline constexpr CharTable kCharTable = makeCharTable();
+
+inline const CharInfo& charInfo(char c) {
+    return kCharTable.entries[static_cast<unsigned char>(c)];
+}
+
+inline bool isBlankChar(char c) { return charInfo(c).flags & kBlankChar; }
+inline bool isIdentChar(char c) { return charInfo(c).flags & kIdentChar; }
+inline bool isDigitChar(char c) { return charInfo(c).flags & kDigitChar; }
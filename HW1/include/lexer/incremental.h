@@ -0,0 +1,42 @@
+#pragma once
+
+#include "lexer/token.h"
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Bytes [offset, offset + oldLength) of the old text were replaced by the
+// newLength bytes at the same offset of the new text.
+struct TextEdit {
+    size_t offset;
+    size_t oldLength;
+    size_t newLength;
+};
+
+// Tokens [first, first + oldCount) of the old array were replaced by tokens
+// [first, first + newCount) of the new one. Tokens outside the range have
+// the same type and text as before, though their offsets may have moved;
+// a token with any of the replaced bytes is inside it, even if it lexes
+// the same again.
+struct TokenChange {
+    size_t first;
+    size_t oldCount;
+    size_t newCount;
+};
+
+// Brings `tokens`, the result of lexing `oldSource`, up to date with
+// `newSource` after `edit`, and returns the token range that changed.
+//
+// Lexing restarts right after the last token that ends before the edit
+// (the lexer carries no state between tokens, and everything up to there
+// lexes the same) and stops as soon as a new token starts, past the edit,
+// at the shifted position of an old one: from there on the text and hence
+// the tokens are identical. Only the tokens after that point are moved,
+// their views shifted by the change in length; when the edit keeps the
+// length and `newSource` is the same buffer they are not touched at all.
+//
+// Only the address and length of `oldSource` are used (its bytes may
+// already have been overwritten in place). `newSource` must outlive the
+// tokens, as with Lexer.
+TokenChange relex(std::vector<Token>& tokens, std::string_view oldSource, std::string_view newSource,
+                  const TextEdit& edit);
@@ -0,0 +1,15 @@
+#pragma once
+
+#include "common/keywords.h"
+#include "lexer/token.h"
+#include <string_view>
+
+static_assert(static_cast<int>(TokenType::KW_FN) == static_cast<int>(Keyword::Fn) &&
+                  static_cast<int>(TokenType::KW_RETURN) == static_cast<int>(Keyword::Return),
+              "TokenType lists the keywords in the order of Keyword");
+
+// Classifies an identifier-shaped word as one of the keywords or IDENTIFIER
+inline TokenType classifyWord(std::string_view word) {
+    Keyword keyword = classifyKeyword(word);
+    return keyword == Keyword::None ? TokenType::IDENTIFIER : static_cast<TokenType>(keyword);
+}
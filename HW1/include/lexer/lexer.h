@@ -1,32 +1,46 @@
 #pragma once
 
+#include "lexer/scan.h"
 #include "lexer/token.h"
-#include <string>
+#include "lexer/token_buffer.h"
+#include <string_view>
 #include <vector>
 
 class Lexer {
 public:
-    explicit Lexer(const std::string& source);
+    // The lexer does not copy `source`; it and the returned tokens view it.
+    // Only byte offsets are tracked: see LineIndex for line and column.
+    explicit Lexer(std::string_view source);
 
+    // Starts at byte `pos` of `source`, which must be the start of a token or
+    // of a blank/comment run. Tokens still view `source`.
+    Lexer(std::string_view source, size_t pos);
+
+    // Scans and returns the next token. Once the input is exhausted every call
+    // returns END_OF_FILE, so callers can pull tokens on demand without ever
+    // materialising the whole stream.
+    Token nextToken();
+
+    // Convenience wrapper: every token up to and including END_OF_FILE.
     std::vector<Token> tokenize();
 
+    // Appends the same tokens to `out`, which must view this lexer's source.
+    // Returns false, leaving `out` untouched, when the source is too large
+    // for TokenBuffer.
+    bool tokenize(TokenBuffer& out);
+
 private:
-    std::string source_;
+    std::string_view source_;
     size_t pos_;
-    int line_;
-    int column_;
+    const scan::Kernels& scan_;
 
     bool isAtEnd() const;
     char peek() const;
-    char peekNext() const;
-    char advance();
-    bool match(char expected);
 
-    void skipWhitespace();
-    Token scanToken();
-    Token scanIdentifierOrKeyword();
-    Token scanNumber();
-    Token scanString();
+    Token scanIdentifierOrKeyword(size_t start);
+    Token scanNumber(size_t start);
+    Token scanString(size_t start);
 
-    Token makeToken(TokenType type, const std::string& lexeme, int startLine, int startCol);
+    // Token whose lexeme is source_[start, pos_).
+    Token makeToken(TokenType type, size_t start) const;
 };
@@ -0,0 +1,44 @@
+#pragma once
+
+#include "lexer/token.h"
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// 1-based line and column, the column counted in bytes
+struct Position {
+    int line;
+    int column;
+};
+
+// Start offset of every line of a source, collected in one pass of the
+// newline scan kernel. The Lexer only tracks offsets; code that prints
+// positions builds an index and looks them up here, by binary search.
+class LineIndex {
+public:
+    LineIndex() = default;
+    explicit LineIndex(std::string_view source);
+
+    std::string_view source() const { return source_; }
+    size_t lines() const { return starts_.size(); }
+
+    Position locate(size_t offset) const;
+
+    // Same, trying the line found by the previous call through `hint`
+    // (initially 0) and the next one before searching: tokens visited in
+    // order mostly stay on a line or move to the following one.
+    Position locate(size_t offset, size_t& hint) const;
+
+    // Position of a token viewing source(): its first character, which for
+    // a STRING is the opening quote
+    Position locate(const Token& token) const { return locate(offsetOf(token)); }
+    Position locate(const Token& token, size_t& hint) const { return locate(offsetOf(token), hint); }
+
+    size_t memoryBytes() const { return starts_.capacity() * sizeof(size_t); }
+
+private:
+    std::string_view source_;
+    std::vector<size_t> starts_;
+
+    size_t offsetOf(const Token& token) const { return static_cast<size_t>(token.start() - source_.data()); }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "lexer/token.h"
+#include "lexer/token_buffer.h"
+#include <cstddef>
+#include <string_view>
+#include <vector>
+
+// Lexes one large buffer on several threads and returns exactly the tokens
+// Lexer(source).tokenize() would, END_OF_FILE included.
+//
+// The buffer is cut into chunks just after a newline. Only string literals
+// can span lines, so the serial lexer is in one of two states at any chunk
+// start: between tokens, or inside a string. A first parallel pass records,
+// per chunk, how each of the two entry states carries through to its end
+// (and, when entered inside a string, where that string closes); a short
+// serial pass chains the chunks to find every real entry state, and a
+// second parallel pass lexes each chunk from there. A string that crosses
+// a boundary belongs to the chunk it opens in, whose lexer runs past its
+// end; the chunk it closes in starts right after the closing quote. The
+// per-chunk token arrays are then concatenated.
+//
+// `threads` == 0 means one per hardware thread. `chunkSize` is the target
+// chunk length; inputs shorter than two chunks are lexed serially.
+std::vector<Token> tokenizeParallel(std::string_view source, unsigned threads = 0,
+                                    size_t chunkSize = 4 << 20);
+
+// The same tokens in compact form: `out` is replaced by a buffer viewing
+// `source`. Returns false when the source is too large for TokenBuffer.
+bool tokenizeParallel(std::string_view source, TokenBuffer& out, unsigned threads = 0,
+                      size_t chunkSize = 4 << 20);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+
+// Bulk scanning kernels used by the Lexer's hot loops. Each skip kernel
+// starts at `pos` and returns the index of the first byte in `data[0, size)`
+// that ends the run (or `size`). SSE2 and AVX2 versions classify 16 or 32 bytes per
+// step; the implementation is chosen once at startup from the CPU features,
+// with a scalar fallback on other targets.
+namespace scan {
+
+struct Kernels {
+    const char* name;
+
+    // ' ', '\t', '\r', '\n'
+    size_t (*skipBlanks)(const char* data, size_t pos, size_t size);
+    // Everything up to the next '\n' (a line comment body)
+    size_t (*skipToNewline)(const char* data, size_t pos, size_t size);
+    // [A-Za-z0-9_]
+    size_t (*skipIdentifier)(const char* data, size_t pos, size_t size);
+    // [0-9]
+    size_t (*skipDigits)(const char* data, size_t pos, size_t size);
+    // Everything up to the next '"' or '\n' (a string literal body)
+    size_t (*skipStringBody)(const char* data, size_t pos, size_t size);
+
+    // Stores the offset just past every '\n' in data[pos, size) into `out`,
+    // which has room for size - pos entries, and returns how many (LineIndex)
+    size_t (*lineStarts)(const char* data, size_t pos, size_t size, size_t* out);
+};
+
+// Kernels for the running CPU. Setting LEXER_SCAN=scalar|sse2|avx2 in the
+// environment forces a specific implementation if it is available.
+const Kernels& active();
+
+const Kernels& scalar();
+// nullptr when the ISA is not compiled in or not supported by this CPU.
+const Kernels* sse2();
+const Kernels* avx2();
+
+} // namespace scan
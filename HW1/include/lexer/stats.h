@@ -0,0 +1,62 @@
+#pragma once
+
+#include "common/stats.h"
+#include "lexer/token.h"
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+// The counters behind `rustc --stats`, on top of the phase timing of
+// common/stats.h. Built only with LEXER_STATS=1 (the CMake option of the
+// same name, on by default); otherwise PhaseTimer and RunStats::count()
+// compile to nothing and the CLI rejects --stats.
+
+// Read only opens (maps) the file: its pages are faulted in by the first
+// pass over them, which is lexing. A file lexed as it is printed spends
+// both in LexPrint; only --parallel lexes ahead, into Lex, then Print.
+enum class Phase : uint8_t { Read, Lex, Print, LexPrint };
+
+// "read", "lex", "print" or "lex+print"
+const char* phaseName(Phase phase);
+
+struct RunStats : PhaseStats {
+    static constexpr size_t kPhases = 4;
+    static_assert(kPhases <= kMaxPhases, "PhaseStats keeps kMaxPhases phases");
+    static constexpr size_t kTokenTypes = static_cast<size_t>(TokenType::ERROR) + 1;
+
+    uint64_t tokens[kTokenTypes] = {};
+
+    // Starts counting the tokens of a new source of `size` bytes
+    void beginFile(size_t size) {
+        if constexpr (kStatsEnabled) {
+            PhaseStats::beginFile(size);
+            depth_ = 0;
+        }
+    }
+
+    // Counts one token of the current source; maxDepth is the deepest `{`
+    // nesting
+    void count(const Token& token) {
+        if constexpr (kStatsEnabled) {
+            tokens[static_cast<size_t>(token.type)]++;
+            if (token.type == TokenType::LBRACE) {
+                if (++depth_ > maxDepth) maxDepth = depth_;
+            } else if (token.type == TokenType::RBRACE && depth_ > 0) {
+                depth_--;
+            }
+        }
+    }
+
+    uint64_t tokenCount() const;
+
+    // Adds the counts and times of `other`, e.g. another worker's
+    void merge(const RunStats& other);
+
+    // A table for people, or one JSON object on a single line. With
+    // kAllocStatsEnabled both include the heap allocations of the run.
+    void writeText(std::ostream& out) const;
+    void writeJson(std::ostream& out) const;
+
+private:
+    uint32_t depth_ = 0;
+};
@@ -1,9 +1,12 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <ostream>
 
-enum class TokenType {
+// One byte, so TokenBuffer can store kinds as a byte array
+enum class TokenType : uint8_t {
     // Keywords
     KW_FN,
     KW_LET,
@@ -86,15 +89,27 @@ inline std::ostream& operator<<(std::ostream& os, TokenType type) {
     return os;
 }
 
+// A token borrows its text from the source buffer handed to the Lexer, so the
+// buffer must outlive every token produced from it. For STRING tokens the
+// lexeme is the raw body between the quotes. Its line and column are not
+// stored; a LineIndex of the source derives them from start().
 struct Token {
     TokenType type;
-    std::string lexeme;
-    int line;
-    int column;
+    std::string_view lexeme;
+
+    // First character of the token: the opening quote of a STRING, else
+    // the start of the lexeme
+    const char* start() const { return lexeme.data() - (type == TokenType::STRING ? 1 : 0); }
+
+    // Owned copy of the lexeme.
+    std::string text() const { return std::string(lexeme); }
+
+    // Value of the literal with escape sequences (\n, \t, \\, ...) decoded.
+    // Only STRING tokens are rewritten; anything else returns text().
+    std::string cooked() const;
 };
 
 inline std::ostream& operator<<(std::ostream& os, const Token& token) {
-    os << token.line << ":" << token.column << "  "
-       << tokenTypeToString(token.type) << "  " << token.lexeme;
+    os << tokenTypeToString(token.type) << "  " << token.lexeme;
     return os;
 }
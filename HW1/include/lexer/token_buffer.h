@@ -0,0 +1,62 @@
+#pragma once
+
+#include "lexer/line_index.h"
+#include "lexer/token.h"
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+// Struct-of-arrays token storage. A token is its kind (1 byte) plus the
+// offset and length of its lexeme in the source (4 bytes each): 9 bytes
+// against the 24 of a Token, and code that only looks at kinds, such as a
+// parser's lookahead, walks a plain byte array. The lexeme and position are
+// derived from the source when asked for.
+//
+// Like Tokens, a buffer views its source, which must outlive it and be
+// shorter than 4 GiB so offsets fit in 32 bits.
+class TokenBuffer {
+public:
+    static constexpr size_t kMaxSource = UINT32_MAX;
+
+    explicit TokenBuffer(std::string_view source = {}) : source_(source) {}
+
+    std::string_view source() const { return source_; }
+    size_t size() const { return kinds_.size(); }
+    bool empty() const { return kinds_.empty(); }
+
+    void reserve(size_t count);
+    void resize(size_t count);
+    void clear();
+
+    // Appends a token lexed from source(); its lexeme must view source().
+    void push_back(const Token& token);
+
+    // Overwrites tokens [at, at + from.size()) with those of `from`, which
+    // must view the same source. Buffers lexed in parallel are stitched
+    // together this way.
+    void assign(size_t at, const TokenBuffer& from);
+
+    TokenType kind(size_t i) const { return kinds_[i]; }
+    const TokenType* kinds() const { return kinds_.data(); }
+    uint32_t offset(size_t i) const { return offsets_[i]; }
+    uint32_t length(size_t i) const { return lengths_[i]; }
+    std::string_view lexeme(size_t i) const { return source_.substr(offsets_[i], lengths_[i]); }
+
+    // The token as the Lexer returned it
+    Token token(size_t i) const { return Token{kinds_[i], lexeme(i)}; }
+
+    // Position of token(i). The first call builds a LineIndex of the
+    // source, so it must not race with other calls on the same buffer.
+    Position position(size_t i) const;
+
+    // Bytes held by the arrays, capacity included
+    size_t memoryBytes() const;
+
+private:
+    std::string_view source_;
+    std::vector<TokenType> kinds_;
+    std::vector<uint32_t> offsets_;
+    std::vector<uint32_t> lengths_;
+    mutable LineIndex lines_;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "lexer/line_index.h"
+#include "lexer/token.h"
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// Binary token stream written by `rustc --format=binary`. All integers are
+// little-endian.
+//
+//   header   magic "RLXT", u16 version, u16 record size,
+//            u64 token count, u64 blob size                    (24 bytes)
+//   records  one per token: u8 type, 3 zero bytes, u32 line,
+//            u32 column, u32 lexeme offset, u32 lexeme length  (20 bytes)
+//   blob     the lexemes, back to back
+//
+// Records are fixed-size so a reader can index them directly; the offset
+// and length locate the lexeme in the blob. A reader must reject streams
+// with a version or record size it does not know. Several streams may be
+// concatenated (rustc does so in batch mode, one per input file).
+constexpr char kTokenStreamMagic[4] = {'R', 'L', 'X', 'T'};
+constexpr uint16_t kTokenStreamVersion = 1;
+constexpr size_t kTokenStreamHeaderSize = 24;
+constexpr size_t kTokenRecordSize = 20;
+
+// Lexeme offsets are 32-bit, so a stream holds at most this many bytes of
+// lexemes. The lexemes of a file never add up to more than the file, so
+// any file up to this size can be written.
+constexpr uint64_t kTokenStreamMaxBlob = UINT32_MAX;
+
+// Collects tokens and writes them as one stream with three large writes.
+// The lexemes added must fit in kTokenStreamMaxBlob bytes.
+class TokenStreamWriter {
+public:
+    void add(const Token& token, Position position);
+    size_t size() const { return count_; }
+
+    // Writes the stream, or appends it to `out`, and starts over empty
+    void write(std::ostream& out);
+    void write(std::string& out);
+
+private:
+    std::string records_;
+    std::string blob_;
+    size_t count_ = 0;
+
+    void header(char* out) const;
+    void clear();
+};
+
+// A decoded stream. The tokens view `blob`, whose buffer moves with the
+// object but is not shared by copies; positions[i] is where tokens[i] was.
+struct TokenStream {
+    std::vector<Token> tokens;
+    std::vector<Position> positions;
+    std::vector<char> blob;
+};
+
+// Reads the next stream from `in`. Returns false at the end of the input or
+// on a malformed stream; `error`, if given, says which (empty at the end).
+bool readTokenStream(std::istream& in, TokenStream& stream, std::string* error = nullptr);
@@ -0,0 +1,102 @@
+#include "lexer/incremental.h"
+#include "lexer/lexer.h"
+
+#include <algorithm>
+
+namespace {
+
+// Byte range a token was scanned from. A STRING lexeme excludes its quotes.
+size_t tokenStart(const Token& token, const char* base) {
+    return static_cast<size_t>(token.lexeme.data() - base) - (token.type == TokenType::STRING ? 1 : 0);
+}
+
+size_t tokenEnd(const Token& token, const char* base) {
+    return static_cast<size_t>(token.lexeme.data() + token.lexeme.size() - base) +
+           (token.type == TokenType::STRING ? 1 : 0);
+}
+
+// True when `a` (old) and `b` (new) are the same token, clear of the edited
+// bytes on both sides: at the same offset before the edit, or shifted by
+// the change in length after it
+bool sameToken(const Token& a, const char* oldBase, const Token& b, const char* newBase, const TextEdit& edit) {
+    if (a.type != b.type || a.lexeme.size() != b.lexeme.size()) return false;
+    size_t oldStart = tokenStart(a, oldBase);
+    size_t newStart = tokenStart(b, newBase);
+    if (tokenEnd(a, oldBase) <= edit.offset && newStart == oldStart) return true;
+    return oldStart >= edit.offset + edit.oldLength && newStart == oldStart - edit.oldLength + edit.newLength;
+}
+
+} // namespace
+
+TokenChange relex(std::vector<Token>& tokens, std::string_view oldSource, std::string_view newSource,
+                  const TextEdit& edit) {
+    const char* oldBase = oldSource.data();
+    const char* newBase = newSource.data();
+    const ptrdiff_t delta = static_cast<ptrdiff_t>(edit.newLength) - static_cast<ptrdiff_t>(edit.oldLength);
+    const size_t newEditEnd = edit.offset + edit.newLength;
+
+    // The first token that reaches the edit (its end byte may be the one the
+    // lexer peeked at to stop it) is the first one that can change
+    size_t first = std::partition_point(tokens.begin(), tokens.end(), [&](const Token& t) {
+        return tokenEnd(t, oldBase) < edit.offset;
+    }) - tokens.begin();
+
+    // Restart where the previous token ended; its text is unchanged
+    size_t pos = first > 0 ? tokenEnd(tokens[first - 1], oldBase) : 0;
+
+    // Re-lex until a token past the edit starts where a shifted old one did
+    Lexer lexer(newSource, pos);
+    std::vector<Token> fresh;
+    size_t last = first;     // old tokens [first, last) are replaced
+    for (;;) {
+        Token token = lexer.nextToken();
+        size_t start = tokenStart(token, newBase);
+        if (start >= newEditEnd) {
+            size_t oldStart = static_cast<size_t>(static_cast<ptrdiff_t>(start) - delta);
+            while (last < tokens.size() && tokenStart(tokens[last], oldBase) < oldStart) last++;
+            if (last < tokens.size() && tokenStart(tokens[last], oldBase) == oldStart) break;
+        }
+        fresh.push_back(token);
+        if (token.type == TokenType::END_OF_FILE) {
+            last = tokens.size();
+            break;
+        }
+    }
+
+    // Work out the exact change before the old tokens are overwritten
+    size_t oldCount = last - first;
+    size_t same = 0;
+    while (same < oldCount && same < fresh.size() &&
+           sameToken(tokens[first + same], oldBase, fresh[same], newBase, edit)) {
+        same++;
+    }
+    size_t sameTail = 0;
+    while (sameTail < oldCount - same && sameTail < fresh.size() - same &&
+           sameToken(tokens[last - 1 - sameTail], oldBase, fresh[fresh.size() - 1 - sameTail], newBase, edit)) {
+        sameTail++;
+    }
+    TokenChange change{first + same, oldCount - same - sameTail, fresh.size() - same - sameTail};
+
+    // Move the untouched tokens onto the new buffer
+    if (newBase != oldBase) {
+        for (size_t i = 0; i < first; ++i) {
+            Token& t = tokens[i];
+            t.lexeme = std::string_view(newBase + (t.lexeme.data() - oldBase), t.lexeme.size());
+        }
+    }
+    if (newBase != oldBase || delta != 0) {
+        for (size_t i = last; i < tokens.size(); ++i) {
+            Token& t = tokens[i];
+            t.lexeme = std::string_view(newBase + (t.lexeme.data() - oldBase) + delta, t.lexeme.size());
+        }
+    }
+
+    // Splice the re-lexed tokens in
+    if (fresh.size() == oldCount) {
+        std::copy(fresh.begin(), fresh.end(), tokens.begin() + first);
+    } else {
+        tokens.erase(tokens.begin() + first, tokens.begin() + last);
+        tokens.insert(tokens.begin() + first, fresh.begin(), fresh.end());
+    }
+    return change;
+}
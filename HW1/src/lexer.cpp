@@ -1,30 +1,123 @@
 #include "lexer/lexer.h"
-#include <unordered_map>
+#include "lexer/char_class.h"
+#include "lexer/keywords.h"
+
+// Computed goto (a GNU extension) gives each lexer state its own indirect
+// branch, which the CPU predicts far better than one shared switch. Other
+// compilers get the equivalent switch.
+#if defined(__GNUC__) || defined(__clang__)
+#define LEXER_COMPUTED_GOTO 1
+#else
+#define LEXER_COMPUTED_GOTO 0
+#endif
+
+Lexer::Lexer(std::string_view source)
+    : source_(source), pos_(0), scan_(scan::active()) {}
+
+Lexer::Lexer(std::string_view source, size_t pos)
+    : source_(source), pos_(pos), scan_(scan::active()) {}
+
+// The lexer core: a state machine whose first transition is chosen by the
+// CharClass of the current byte. Blank runs and comments loop back to the
+// dispatch state; every other state produces exactly one token.
+Token Lexer::nextToken() {
+#if LEXER_COMPUTED_GOTO
+    // Indexed by CharClass, in declaration order
+    static void* const states[] = {
+        &&state_other, &&state_blank, &&state_ident, &&state_digit,
+        &&state_quote, &&state_slash, &&state_single, &&state_or_eq,
+    };
+    static_assert(sizeof(states) / sizeof(states[0]) == static_cast<size_t>(CharClass::Count),
+                  "one state per CharClass");
+#endif
+    size_t start;
+    const CharInfo* info;
+
+dispatch:
+    if (isAtEnd()) {
+        return makeToken(TokenType::END_OF_FILE, pos_);
+    }
+    start = pos_;
+    info = &charInfo(source_[pos_]);
+#if LEXER_COMPUTED_GOTO
+    goto *states[static_cast<size_t>(info->start)];
+#else
+    switch (info->start) {
+        case CharClass::Blank:  goto state_blank;
+        case CharClass::Ident:  goto state_ident;
+        case CharClass::Digit:  goto state_digit;
+        case CharClass::Quote:  goto state_quote;
+        case CharClass::Slash:  goto state_slash;
+        case CharClass::Single: goto state_single;
+        case CharClass::OrEq:   goto state_or_eq;
+        case CharClass::Other:
+        case CharClass::Count:  goto state_other;
+    }
+#endif
+
+state_other:
+    // Unknown character — emit ERROR token
+    pos_++;
+    return makeToken(TokenType::ERROR, start);
+
+state_blank:
+    pos_ = scan_.skipBlanks(source_.data(), pos_, source_.size());
+    goto dispatch;
+
+state_slash:
+    if (pos_ + 1 < source_.size() && source_[pos_ + 1] == '/') {
+        // Line comment — consume until end of line
+        pos_ = scan_.skipToNewline(source_.data(), pos_ + 2, source_.size());
+        goto dispatch;
+    }
+    pos_++;
+    return makeToken(TokenType::SLASH, start);
+
+state_single:
+    // Punctuation and single-char operators
+    pos_++;
+    return makeToken(info->token, start);
+
+state_or_eq:
+    // '=', '!', '<', '>' and their two-char forms
+    pos_++;
+    if (!isAtEnd() && source_[pos_] == '=') {
+        pos_++;
+        return makeToken(info->withEq, start);
+    }
+    return makeToken(info->token, start);
 
-static const std::unordered_map<std::string, TokenType> keywords = {
-    {"fn",     TokenType::KW_FN},
-    {"let",    TokenType::KW_LET},
-    {"mut",    TokenType::KW_MUT},
-    {"if",     TokenType::KW_IF},
-    {"else",   TokenType::KW_ELSE},
-    {"while",  TokenType::KW_WHILE},
-    {"return", TokenType::KW_RETURN},
-};
+state_ident:
+    pos_++;
+    return scanIdentifierOrKeyword(start);
 
-Lexer::Lexer(const std::string& source)
-    : source_(source), pos_(0), line_(1), column_(1) {}
+state_digit:
+    pos_++;
+    return scanNumber(start);
+
+state_quote:
+    pos_++;
+    return scanString(start);
+}
 
 std::vector<Token> Lexer::tokenize() {
     std::vector<Token> tokens;
-    while (!isAtEnd()) {
-        skipWhitespace();
-        if (isAtEnd()) break;
-        tokens.push_back(scanToken());
+    for (;;) {
+        tokens.push_back(nextToken());
+        if (tokens.back().type == TokenType::END_OF_FILE) break;
     }
-    tokens.push_back(makeToken(TokenType::END_OF_FILE, "", line_, column_));
     return tokens;
 }
 
+bool Lexer::tokenize(TokenBuffer& out) {
+    if (source_.size() > TokenBuffer::kMaxSource) return false;
+    for (;;) {
+        Token token = nextToken();
+        out.push_back(token);
+        if (token.type == TokenType::END_OF_FILE) return true;
+    }
+}
+
 bool Lexer::isAtEnd() const {
     return pos_ >= source_.size();
 }
@@ -34,153 +127,69 @@ char Lexer::peek() const {
     return source_[pos_];
 }
 
-char Lexer::peekNext() const {
-    if (pos_ + 1 >= source_.size()) return '\0';
-    return source_[pos_ + 1];
+Token Lexer::makeToken(TokenType type, size_t start) const {
+    return Token{type, source_.substr(start, pos_ - start)};
 }
 
-char Lexer::advance() {
-    char c = source_[pos_++];
-    if (c == '\n') {
-        line_++;
-        column_ = 1;
-    } else {
-        column_++;
-    }
-    return c;
-}
+Token Lexer::scanIdentifierOrKeyword(size_t start) {
+    // The first character was already consumed by scanToken
+    pos_ = scan_.skipIdentifier(source_.data(), pos_, source_.size());
 
-bool Lexer::match(char expected) {
-    if (isAtEnd() || source_[pos_] != expected) return false;
-    advance();
-    return true;
+    Token token = makeToken(TokenType::IDENTIFIER, start);
+    token.type = classifyWord(token.lexeme);
+    return token;
 }
 
-void Lexer::skipWhitespace() {
-    while (!isAtEnd()) {
-        char c = peek();
-        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
-            advance();
-        } else if (c == '/' && peekNext() == '/') {
-            // Line comment — consume until end of line
-            advance(); // '/'
-            advance(); // '/'
-            while (!isAtEnd() && peek() != '\n') {
-                advance();
-            }
-        } else {
-            break;
-        }
-    }
-}
+Token Lexer::scanNumber(size_t start) {
+    pos_ = scan_.skipDigits(source_.data(), pos_, source_.size());
 
-Token Lexer::makeToken(TokenType type, const std::string& lexeme, int startLine, int startCol) {
-    return Token{type, lexeme, startLine, startCol};
+    return makeToken(TokenType::INTEGER, start);
 }
 
-Token Lexer::scanToken() {
-    int startLine = line_;
-    int startCol = column_;
-    char c = advance();
-
-    switch (c) {
-        // Punctuation
-        case '(': return makeToken(TokenType::LPAREN,    "(", startLine, startCol);
-        case ')': return makeToken(TokenType::RPAREN,    ")", startLine, startCol);
-        case '{': return makeToken(TokenType::LBRACE,    "{", startLine, startCol);
-        case '}': return makeToken(TokenType::RBRACE,    "}", startLine, startCol);
-        case ';': return makeToken(TokenType::SEMICOLON, ";", startLine, startCol);
-        case ':': return makeToken(TokenType::COLON,     ":", startLine, startCol);
-        case ',': return makeToken(TokenType::COMMA,     ",", startLine, startCol);
-
-        // Single-char operators
-        case '+': return makeToken(TokenType::PLUS,  "+", startLine, startCol);
-        case '-': return makeToken(TokenType::MINUS, "-", startLine, startCol);
-        case '*': return makeToken(TokenType::STAR,  "*", startLine, startCol);
-        case '/': return makeToken(TokenType::SLASH, "/", startLine, startCol);
-
-        // Two-char operators
-        case '=':
-            if (match('=')) return makeToken(TokenType::EQ,  "==", startLine, startCol);
-            return makeToken(TokenType::ASSIGN, "=", startLine, startCol);
-        case '!':
-            if (match('=')) return makeToken(TokenType::NEQ, "!=", startLine, startCol);
-            return makeToken(TokenType::ERROR, "!", startLine, startCol);
-        case '<':
-            if (match('=')) return makeToken(TokenType::LTE, "<=", startLine, startCol);
-            return makeToken(TokenType::LT, "<", startLine, startCol);
-        case '>':
-            if (match('=')) return makeToken(TokenType::GTE, ">=", startLine, startCol);
-            return makeToken(TokenType::GT, ">", startLine, startCol);
-
-        // String literals
-        case '"': return scanString();
-
-        default:
-            // Identifiers and keywords
-            if (std::isalpha(c) || c == '_') {
-                return scanIdentifierOrKeyword();
-            }
-            // Numbers
-            if (std::isdigit(c)) {
-                return scanNumber();
-            }
-            // Unknown character — emit ERROR token
-            return makeToken(TokenType::ERROR, std::string(1, c), startLine, startCol);
+Token Lexer::scanString(size_t start) {
+    // Opening '"' was already consumed by scanToken. The kernel stops at the
+    // closing quote or at a newline, which the string simply runs over.
+    for (;;) {
+        pos_ = scan_.skipStringBody(source_.data(), pos_, source_.size());
+        if (isAtEnd() || peek() == '"') break;
+        pos_++; // '\n'
     }
-}
 
-Token Lexer::scanIdentifierOrKeyword() {
-    // The first character was already consumed by scanToken
-    int startLine = line_;
-    int startCol = column_ - 1; // adjust since first char already advanced column
-    // Handle line boundary: if advance() crossed a newline, startCol was captured in scanToken
-    // Actually, scanToken captured startLine/startCol before advance(), but we don't have access here.
-    // Let's reconstruct: the first char started at (column_ - 1) on the current line.
-
-    size_t start = pos_ - 1; // position of first char in source_
-
-    while (!isAtEnd() && (std::isalnum(peek()) || peek() == '_')) {
-        advance();
+    if (isAtEnd()) {
+        // Unterminated string — the lexeme keeps its opening quote
+        return makeToken(TokenType::ERROR, start);
     }
 
-    std::string lexeme = source_.substr(start, pos_ - start);
-
-    auto it = keywords.find(lexeme);
-    if (it != keywords.end()) {
-        return makeToken(it->second, lexeme, startLine, startCol);
-    }
-    return makeToken(TokenType::IDENTIFIER, lexeme, startLine, startCol);
+    pos_++; // consume closing '"'
+    // The lexeme is the body between the quotes
+    return Token{TokenType::STRING, source_.substr(start + 1, pos_ - start - 2)};
 }
 
-Token Lexer::scanNumber() {
-    int startLine = line_;
-    int startCol = column_ - 1;
-    size_t start = pos_ - 1;
-
-    while (!isAtEnd() && std::isdigit(peek())) {
-        advance();
-    }
+std::string Token::cooked() const {
+    if (type != TokenType::STRING) return text();
 
-    std::string lexeme = source_.substr(start, pos_ - start);
-    return makeToken(TokenType::INTEGER, lexeme, startLine, startCol);
-}
-
-Token Lexer::scanString() {
-    // Opening '"' was already consumed by scanToken
-    int startLine = line_;
-    int startCol = column_ - 1;
     std::string value;
-
-    while (!isAtEnd() && peek() != '"') {
-        value += advance();
-    }
-
-    if (isAtEnd()) {
-        // Unterminated string
-        return makeToken(TokenType::ERROR, "\"" + value, startLine, startCol);
+    value.reserve(lexeme.size());
+    for (size_t i = 0; i < lexeme.size(); ++i) {
+        char c = lexeme[i];
+        if (c != '\\' || i + 1 == lexeme.size()) {
+            value += c;
+            continue;
+        }
+        switch (lexeme[++i]) {
+            case 'n':  value += '\n'; break;
+            case 't':  value += '\t'; break;
+            case 'r':  value += '\r'; break;
+            case '0':  value += '\0'; break;
+            case '\\': value += '\\'; break;
+            case '\'': value += '\''; break;
+            case '"':  value += '"';  break;
+            default:
+                // Unknown escape — keep it verbatim
+                value += '\\';
+                value += lexeme[i];
+                break;
+        }
     }
-
-    advance(); // consume closing '"'
-    return makeToken(TokenType::STRING, value, startLine, startCol);
+    return value;
 }
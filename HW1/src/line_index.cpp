@@ -0,0 +1,39 @@
+#include "lexer/line_index.h"
+#include "lexer/scan.h"
+
+#include <algorithm>
+
+LineIndex::LineIndex(std::string_view source) : source_(source) {
+    starts_.push_back(0);
+    // The kernels fill a fixed buffer a step at a time; the vector only
+    // grows here, in code built for the baseline ISA
+    constexpr size_t kStep = 2048;
+    size_t found[kStep];
+    const scan::Kernels& kernels = scan::active();
+    for (size_t pos = 0; pos < source.size(); pos += kStep) {
+        size_t end = std::min(source.size(), pos + kStep);
+        size_t count = kernels.lineStarts(source.data(), pos, end, found);
+        starts_.insert(starts_.end(), found, found + count);
+    }
+}
+
+Position LineIndex::locate(size_t offset) const {
+    size_t line = std::upper_bound(starts_.begin(), starts_.end(), offset) - starts_.begin() - 1;
+    return Position{static_cast<int>(line) + 1, static_cast<int>(offset - starts_[line]) + 1};
+}
+
+Position LineIndex::locate(size_t offset, size_t& hint) const {
+    size_t line = hint < starts_.size() ? hint : 0;
+    auto within = [&](size_t l) {
+        return starts_[l] <= offset && (l + 1 == starts_.size() || offset < starts_[l + 1]);
+    };
+    if (!within(line)) {
+        if (line + 1 < starts_.size() && within(line + 1)) {
+            line++;
+        } else {
+            line = std::upper_bound(starts_.begin(), starts_.end(), offset) - starts_.begin() - 1;
+        }
+    }
+    hint = line;
+    return Position{static_cast<int>(line) + 1, static_cast<int>(offset - starts_[line]) + 1};
+}
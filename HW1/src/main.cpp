@@ -1,30 +1,290 @@
+#include "common/batch.h"
+#include "common/source_file.h"
+#include "common/trace.h"
 #include "lexer/lexer.h"
+#include "lexer/line_index.h"
+#include "lexer/parallel_lexer.h"
+#include "lexer/stats.h"
+#include "lexer/token_stream.h"
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iostream>
-#include <sstream>
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cerr << "Usage: rustc <file.rs>" << std::endl;
-        return 1;
-    }
+// A phase of one source, timed into `stats` and shown on the --trace timeline
+class PhaseScope {
+public:
+    PhaseScope(RunStats* stats, Phase phase) : timer_(stats, phase), span_(phaseName(phase)) {}
 
-    std::ifstream file(argv[1]);
-    if (!file.is_open()) {
-        std::cerr << "Error: cannot open file '" << argv[1] << "'" << std::endl;
-        return 1;
+private:
+    PhaseTimer timer_;
+    TraceSpan span_;
+};
+
+// "line:column  TYPE  lexeme" and a newline
+static void appendToken(std::string& out, const Token& token, Position position) {
+    char digits[16];
+    auto end = std::to_chars(digits, digits + sizeof digits, position.line).ptr;
+    out.append(digits, end);
+    out += ':';
+    end = std::to_chars(digits, digits + sizeof digits, position.column).ptr;
+    out.append(digits, end);
+    out += "  ";
+    out += tokenTypeToString(token.type);
+    out += "  ";
+    out.append(token.lexeme.data(), token.lexeme.size());
+    out += '\n';
+}
+
+// Text output is collected and written in blocks of about this size
+constexpr size_t kTextBlock = 1 << 20;
+
+// Lexes all of `source` in chunks before anything is printed, for
+// --parallel. The tokens go into `compact`, or into `wide` when the source
+// is too large for a TokenBuffer; returns which.
+static bool lexAhead(std::string_view source, unsigned jobs, TokenBuffer& compact, std::vector<Token>& wide) {
+    compact = TokenBuffer(source);
+    if (tokenizeParallel(source, compact, jobs)) return true;
+    wide = tokenizeParallel(source, jobs);
+    return false;
+}
+
+// Batch mode: every file is lexed on the pool and its tokens are printed
+// under a "==> path <==" header, in the order the paths were given. In
+// binary mode the files' streams are simply concatenated, with an empty
+// stream for a file that cannot be opened or is too large for the format.
+static int runBatch(const std::vector<std::string>& paths, unsigned jobs, bool binary, RunStats* stats) {
+    WorkStealingPool pool(jobs);
+    OrderedWriter writer(paths.size(), std::cout, std::cerr);
+    std::vector<char> failed(paths.size(), 0);
+    std::vector<RunStats> workerStats(stats ? pool.size() : 0);
+
+    pool.run(batchOrder(paths, pool.size()), [&](size_t index, unsigned worker) {
+        const std::string& path = paths[index];
+        TraceSpan span("file", path);
+        RunStats* ws = stats ? &workerStats[worker] : nullptr;
+        std::string out = binary ? std::string() : "==> " + path + " <==\n";
+        std::string err;
+        TokenStreamWriter stream;
+        SourceFile file;
+        bool opened;
+        {
+            PhaseScope scope(ws, Phase::Read);
+            opened = file.open(path);
+        }
+        if (!opened) {
+            err = "Error: cannot open file '" + path + "'\n";
+            failed[index] = 1;
+        } else if (binary && file.view().size() > kTokenStreamMaxBlob) {
+            err = "Error: '" + path + "' is too large for --format=binary\n";
+            failed[index] = 1;
+        } else {
+            std::string_view source = file.view();
+            if (ws) ws->beginFile(source.size());
+            if (!binary) out.reserve(out.size() + source.size() * 4);
+            auto emit = [&](auto next) {
+                LineIndex lines(source);
+                size_t hint = 0;
+                Token token;
+                do {
+                    token = next();
+                    if (ws) ws->count(token);
+                    if (binary) {
+                        stream.add(token, lines.locate(token, hint));
+                    } else {
+                        appendToken(out, token, lines.locate(token, hint));
+                    }
+                } while (token.type != TokenType::END_OF_FILE);
+            };
+            // Interleaved, so the two are timed and traced as one phase
+            PhaseScope scope(ws, Phase::LexPrint);
+            Lexer lexer(source);
+            emit([&] { return lexer.nextToken(); });
+        }
+        if (binary) stream.write(out);
+        writer.publish(index, std::move(out), std::move(err));
+    });
+
+    for (const RunStats& ws : workerStats) stats->merge(ws);
+    for (char f : failed) {
+        if (f) return 1;
     }
+    return 0;
+}
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
+// Writes the tokens of one file, pulling them from `next` until EOF. The
+// tokens view `source`, the file's contents.
+template <class Next>
+static void writeTokens(std::string_view source, Next next, bool binary, RunStats* stats) {
+    LineIndex lines(source);
+    size_t hint = 0;
+    if (binary) {
+        TokenStreamWriter stream;
+        Token token;
+        do {
+            token = next();
+            if (stats) stats->count(token);
+            stream.add(token, lines.locate(token, hint));
+        } while (token.type != TokenType::END_OF_FILE);
+        stream.write(std::cout);
+        std::cout.flush();
+        return;
+    }
 
-    Lexer lexer(source);
-    auto tokens = lexer.tokenize();
+    std::string out;
+    out.reserve(kTextBlock + 4096);
+    Token token;
+    do {
+        token = next();
+        if (stats) stats->count(token);
+        appendToken(out, token, lines.locate(token, hint));
+        if (out.size() >= kTextBlock) {
+            std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+            out.clear();
+        }
+    } while (token.type != TokenType::END_OF_FILE);
+    std::cout.write(out.data(), static_cast<std::streamsize>(out.size()));
+    std::cout.flush();
+}
 
-    for (const auto& token : tokens) {
-        std::cout << token << std::endl;
+// One file: lexed and printed as it goes, or, for --parallel, lexed
+// completely first
+static int runSingle(const std::string& path, bool parallel, unsigned jobs, bool binary, RunStats* stats) {
+    TraceSpan span("file", path);
+    SourceFile file;
+    bool opened;
+    {
+        PhaseScope scope(stats, Phase::Read);
+        opened = file.open(path);
+    }
+    if (!opened) {
+        std::cerr << "Error: cannot open file '" << path << "'" << std::endl;
+        return 1;
     }
+    std::string_view source = file.view();
+    if (binary && source.size() > kTokenStreamMaxBlob) {
+        std::cerr << "Error: '" << path << "' is too large for --format=binary" << std::endl;
+        return 1;
+    }
+    if (stats) stats->beginFile(source.size());
 
+    if (parallel) {
+        // Hold the tokens compactly; only a source past 4 GiB needs Tokens
+        TokenBuffer compact;
+        std::vector<Token> wide;
+        bool fits;
+        {
+            PhaseScope scope(stats, Phase::Lex);
+            fits = lexAhead(source, jobs, compact, wide);
+        }
+        PhaseScope scope(stats, Phase::Print);
+        size_t i = 0;
+        if (fits) {
+            writeTokens(source, [&] { return compact.token(i++); }, binary, stats);
+        } else {
+            writeTokens(source, [&] { return wide[i++]; }, binary, stats);
+        }
+    } else {
+        PhaseScope scope(stats, Phase::LexPrint);
+        Lexer lexer(source);
+        writeTokens(source, [&] { return lexer.nextToken(); }, binary, stats);
+    }
     return 0;
 }
+
+int main(int argc, char* argv[]) {
+    // --jobs=N: number of worker threads in batch mode (default: all cores)
+    // --files-from=LIST: read further paths from LIST, one per line
+    // --parallel: lex a single large file in chunks on --jobs threads (not
+    //   with several files, which batch mode already spreads over --jobs)
+    // --format=text|binary: token dump (default) or the stream of token_stream.h
+    // --stats[=json]: time the phases and count tokens; the report goes to
+    //   stderr, as a table or as one JSON object. Lexing and printing are
+    //   timed apart only with --parallel, otherwise as one lex+print phase
+    // --trace=FILE: save a timeline of the files, phases and --parallel
+    //   chunks of every thread as Chrome trace-event JSON
+    unsigned jobs = 0;
+    bool parallel = false;
+    bool binary = false;
+    const char* statsFormat = nullptr;
+    const char* tracePath = nullptr;
+    std::vector<std::string> paths;
+    bool batch = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strncmp(argv[i], "--jobs=", 7) == 0) {
+            if (!parseJobs(argv[i] + 7, jobs)) {
+                std::cerr << "Error: --jobs takes a thread count from 0 to " << kMaxJobs << ", not '" << (argv[i] + 7)
+                          << "'" << std::endl;
+                return 1;
+            }
+        } else if (std::strcmp(argv[i], "--parallel") == 0) {
+            parallel = true;
+        } else if (std::strcmp(argv[i], "--stats") == 0 || std::strcmp(argv[i], "--stats=text") == 0) {
+            statsFormat = "text";
+        } else if (std::strcmp(argv[i], "--stats=json") == 0) {
+            statsFormat = "json";
+        } else if (std::strncmp(argv[i], "--trace=", 8) == 0) {
+            tracePath = argv[i] + 8;
+        } else if (std::strncmp(argv[i], "--format=", 9) == 0) {
+            if (std::strcmp(argv[i] + 9, "binary") == 0) {
+                binary = true;
+            } else if (std::strcmp(argv[i] + 9, "text") == 0) {
+                binary = false;
+            } else {
+                std::cerr << "Error: unknown format '" << (argv[i] + 9) << "'" << std::endl;
+                return 1;
+            }
+        } else if (std::strncmp(argv[i], "--files-from=", 13) == 0) {
+            batch = true;
+            if (!readPathList(argv[i] + 13, paths)) {
+                std::cerr << "Error: cannot read file list '" << (argv[i] + 13) << "'" << std::endl;
+                return 1;
+            }
+        } else {
+            paths.push_back(argv[i]);
+        }
+    }
+    if (paths.empty() && !batch) {
+        std::cerr << "Usage: rustc [--jobs=N] [--parallel] [--format=text|binary] [--stats[=json]] [--trace=FILE] "
+                     "[--files-from=LIST] <file.rs | -> [more.rs ...]" << std::endl;
+        return 1;
+    }
+    if (parallel && (batch || paths.size() > 1)) {
+        std::cerr << "Error: --parallel lexes a single file; batch mode already runs files in parallel" << std::endl;
+        return 1;
+    }
+    if ((statsFormat || tracePath) && !kStatsEnabled) {
+        std::cerr << "Error: --stats and --trace are not available in this build (LEXER_STATS=OFF)" << std::endl;
+        return 1;
+    }
+
+    if (tracePath) Tracer::start("rustc");
+    RunStats stats;
+    RunStats* wanted = statsFormat ? &stats : nullptr;
+    int status;
+    {
+        PhaseTimer timer(wanted ? &stats.total : nullptr, true);
+        if (batch || paths.size() > 1) {
+            status = runBatch(paths, jobs, binary, wanted);
+        } else {
+            status = runSingle(paths[0], parallel, jobs, binary, wanted);
+        }
+    }
+    if (wanted) {
+        if (std::strcmp(statsFormat, "json") == 0) {
+            stats.writeJson(std::cerr);
+        } else {
+            stats.writeText(std::cerr);
+        }
+    }
+    if (tracePath) {
+        // The workers are done, so their buffers can be read
+        std::ofstream file(tracePath);
+        Tracer::write(file);
+        if (!file) {
+            std::cerr << "Error: cannot write file '" << tracePath << "'" << std::endl;
+            return 1;
+        }
+    }
+    return status;
+}
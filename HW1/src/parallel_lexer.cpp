@@ -0,0 +1,209 @@
+#include "lexer/parallel_lexer.h"
+#include "common/batch.h"
+#include "common/trace.h"
+#include "lexer/lexer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace {
+
+constexpr size_t kNoClose = static_cast<size_t>(-1);
+
+// `Tokens` is std::vector<Token> or TokenBuffer
+template <class Tokens>
+struct Chunk {
+    size_t begin;
+    size_t end;                              // just past a '\n', or the end of the input
+    bool exitsInString[2] = {false, false};  // state at `end`, indexed by entry state
+    size_t close = kNoClose;                 // entered inside a string: just past its closing quote
+
+    // Set by the serial pass
+    bool entersInString = false;
+
+    Tokens tokens;
+};
+
+// The container-specific steps
+void startTokens(std::vector<Token>&, std::string_view) {}
+void startTokens(TokenBuffer& tokens, std::string_view source) { tokens = TokenBuffer(source); }
+
+bool lexAll(std::string_view source, std::vector<Token>& out) {
+    out = Lexer(source).tokenize();
+    return true;
+}
+bool lexAll(std::string_view source, TokenBuffer& out) {
+    out = TokenBuffer(source);
+    return Lexer(source).tokenize(out);
+}
+
+void place(std::vector<Token>& out, size_t at, const std::vector<Token>& from) {
+    std::copy(from.begin(), from.end(), out.begin() + at);
+}
+void place(TokenBuffer& out, size_t at, const TokenBuffer& from) { out.assign(at, from); }
+
+// Next '"' or '/' at or after a position. Both memchr results are cached,
+// so a run of one character does not rescan up to the other every time.
+class QuoteOrSlash {
+public:
+    QuoteOrSlash(const char* data, size_t pos, size_t end)
+        : data_(data), end_(end), quote_(find('"', pos)), slash_(find('/', pos)) {}
+
+    size_t next(size_t pos) {
+        if (quote_ < pos) quote_ = find('"', pos);
+        if (slash_ < pos) slash_ = find('/', pos);
+        return std::min(quote_, slash_);
+    }
+
+private:
+    const char* data_;
+    size_t end_;
+    size_t quote_;
+    size_t slash_;
+
+    size_t find(char c, size_t pos) const {
+        const void* hit = pos < end_ ? std::memchr(data_ + pos, c, end_ - pos) : nullptr;
+        return hit ? static_cast<const char*>(hit) - data_ : end_;
+    }
+};
+
+// Tracks whether the lexer would be inside a string literal across
+// data[pos, end), honouring line comments. Returns the state at `end`. When
+// `close` is given, it receives the position just past the first closing
+// quote.
+bool carryState(const char* data, size_t pos, size_t end, bool inString, size_t* close) {
+    QuoteOrSlash finder(data, pos, end);
+    while (pos < end) {
+        if (inString) {
+            const void* quote = std::memchr(data + pos, '"', end - pos);
+            if (!quote) return true;
+            pos = static_cast<const char*>(quote) - data + 1;
+            inString = false;
+            if (close && *close == kNoClose) *close = pos;
+            continue;
+        }
+        pos = finder.next(pos);
+        if (pos >= end) break;
+        if (data[pos] == '"') {
+            inString = true;
+            pos++;
+        } else if (pos + 1 < end && data[pos + 1] == '/') {
+            const void* nl = std::memchr(data + pos + 2, '\n', end - pos - 2);
+            pos = nl ? static_cast<const char*>(nl) - data : end;
+        } else {
+            pos++;
+        }
+    }
+    return inString;
+}
+
+template <class Tokens>
+void summarize(const char* data, Chunk<Tokens>& chunk) {
+    chunk.exitsInString[0] = carryState(data, chunk.begin, chunk.end, false, nullptr);
+    chunk.exitsInString[1] = carryState(data, chunk.begin, chunk.end, true, &chunk.close);
+}
+
+// Lexes the tokens that start in `chunk`. The last one may run past its end.
+template <class Tokens>
+void lexChunk(std::string_view source, Chunk<Tokens>& chunk, bool last) {
+    size_t pos = chunk.begin;
+    if (chunk.entersInString) {
+        // The string belongs to an earlier chunk; start after it
+        if (chunk.close == kNoClose) return;
+        pos = chunk.close;
+    }
+    // Tokens starting at or past here belong to the next chunk
+    const size_t limit = last ? SIZE_MAX : chunk.end;
+
+    // Typical code has a token every few bytes
+    startTokens(chunk.tokens, source);
+    chunk.tokens.reserve((chunk.end - pos) / 4 + 16);
+    Lexer lexer(source, pos);
+    auto offsetOf = [&](const Token& token) { return static_cast<size_t>(token.start() - source.data()); };
+    const char* sourceEnd = source.data() + source.size();
+    bool reachedEnd = false;
+    for (;;) {
+        Token token = lexer.nextToken();
+        if (token.type == TokenType::END_OF_FILE) {
+            // Ours if it lies in this chunk, or if our last token (an
+            // unterminated string) ran into it
+            if (offsetOf(token) < limit || reachedEnd) chunk.tokens.push_back(token);
+            return;
+        }
+        if (offsetOf(token) >= limit) return;
+        reachedEnd = token.lexeme.data() + token.lexeme.size() == sourceEnd;
+        chunk.tokens.push_back(token);
+    }
+}
+
+template <class Tokens>
+bool tokenizeChunked(std::string_view source, Tokens& tokens, unsigned threads, size_t chunkSize) {
+    const char* data = source.data();
+    const size_t size = source.size();
+    if (chunkSize == 0) chunkSize = 1;
+
+    std::vector<Chunk<Tokens>> chunks;
+    for (size_t begin = 0; begin < size;) {
+        size_t end = begin + std::min(chunkSize, size - begin);
+        if (end < size) {
+            const void* nl = std::memchr(data + end, '\n', size - end);
+            end = nl ? static_cast<const char*>(nl) - data + 1 : size;
+        }
+        Chunk<Tokens> chunk;
+        chunk.begin = begin;
+        chunk.end = end;
+        chunks.push_back(std::move(chunk));
+        begin = end;
+    }
+    if (chunks.size() < 2) {
+        return lexAll(source, tokens);
+    }
+
+    WorkStealingPool pool(threads);
+    std::vector<size_t> order(chunks.size());
+    for (size_t i = 0; i < order.size(); ++i) order[i] = i;
+
+    pool.run(order, [&](size_t i, unsigned) {
+        TraceSpan span("summarize chunk");
+        summarize(data, chunks[i]);
+    });
+
+    bool inString = false;
+    for (Chunk<Tokens>& chunk : chunks) {
+        chunk.entersInString = inString;
+        inString = chunk.exitsInString[inString];
+    }
+
+    pool.run(order, [&](size_t i, unsigned) {
+        TraceSpan span("lex chunk");
+        lexChunk(source, chunks[i], i + 1 == chunks.size());
+    });
+
+    // Stitch: every chunk copies its tokens into place on the pool
+    std::vector<size_t> offsets(chunks.size() + 1, 0);
+    for (size_t i = 0; i < chunks.size(); ++i) {
+        offsets[i + 1] = offsets[i] + chunks[i].tokens.size();
+    }
+    startTokens(tokens, source);
+    tokens.resize(offsets.back());
+    pool.run(order, [&](size_t i, unsigned) {
+        TraceSpan span("place chunk");
+        place(tokens, offsets[i], chunks[i].tokens);
+        chunks[i].tokens = Tokens();
+    });
+    return true;
+}
+
+} // namespace
+
+std::vector<Token> tokenizeParallel(std::string_view source, unsigned threads, size_t chunkSize) {
+    std::vector<Token> tokens;
+    tokenizeChunked(source, tokens, threads, chunkSize);
+    return tokens;
+}
+
+bool tokenizeParallel(std::string_view source, TokenBuffer& out, unsigned threads, size_t chunkSize) {
+    if (source.size() > TokenBuffer::kMaxSource) return false;
+    return tokenizeChunked(source, out, threads, chunkSize);
+}
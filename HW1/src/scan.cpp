@@ -0,0 +1,77 @@
+#include "lexer/scan.h"
+#include "scan_kernels.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <initializer_list>
+
+namespace {
+
+size_t scalarBlanks(const char* data, size_t pos, size_t size) {
+    while (pos < size && isBlankByte(data[pos])) pos++;
+    return pos;
+}
+
+size_t scalarToNewline(const char* data, size_t pos, size_t size) {
+    while (pos < size && data[pos] != '\n') pos++;
+    return pos;
+}
+
+size_t scalarIdentifier(const char* data, size_t pos, size_t size) {
+    while (pos < size && isIdentifierByte(data[pos])) pos++;
+    return pos;
+}
+
+size_t scalarDigits(const char* data, size_t pos, size_t size) {
+    while (pos < size && isDigitByte(data[pos])) pos++;
+    return pos;
+}
+
+size_t scalarStringBody(const char* data, size_t pos, size_t size) {
+    while (pos < size && data[pos] != '"' && data[pos] != '\n') pos++;
+    return pos;
+}
+
+size_t scalarLineStarts(const char* data, size_t pos, size_t size, size_t* out) {
+    size_t count = 0;
+    for (; pos < size; ++pos) {
+        if (data[pos] == '\n') out[count++] = pos + 1;
+    }
+    return count;
+}
+
+const scan::Kernels scalarTable = {
+    "scalar", scalarBlanks, scalarToNewline, scalarIdentifier, scalarDigits, scalarStringBody,
+    scalarLineStarts,
+};
+
+const scan::Kernels& select() {
+    const char* forced = std::getenv("LEXER_SCAN");
+    const scan::Kernels* best = nullptr;
+    for (const scan::Kernels* k : {scan::avx2(), scan::sse2(), &scalarTable}) {
+        if (!k) continue;
+        if (forced && std::strcmp(forced, k->name) == 0) return *k;
+        if (!best) best = k;
+    }
+    return *best;
+}
+
+} // namespace
+
+namespace scan {
+
+const Kernels& scalar() {
+    return scalarTable;
+}
+
+#ifndef LEXER_SCAN_X86
+const Kernels* sse2() { return nullptr; }
+const Kernels* avx2() { return nullptr; }
+#endif
+
+const Kernels& active() {
+    static const Kernels& chosen = select();
+    return chosen;
+}
+
+} // namespace scan
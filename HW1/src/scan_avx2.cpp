@@ -0,0 +1,41 @@
+// Built with -mavx2; only reached after the CPU has been checked for AVX2.
+#include "lexer/scan.h"
+#include "scan_kernels.h"
+
+#include <immintrin.h>
+
+namespace {
+
+struct Avx2Ops {
+    using V = __m256i;
+    static constexpr size_t kWidth = 32;
+    static constexpr uint32_t kAll = 0xFFFFFFFFu;
+
+    static V load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+    static V splat(char c) { return _mm256_set1_epi8(c); }
+    static V eq(V a, V b) { return _mm256_cmpeq_epi8(a, b); }
+    static V orV(V a, V b) { return _mm256_or_si256(a, b); }
+    // Signed compares: bytes >= 0x80 are negative and never fall in an ASCII range
+    static V range(V v, char lo, char hi) {
+        return _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8(static_cast<char>(lo - 1))),
+                                _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(hi + 1)), v));
+    }
+    static uint32_t mask(V v) { return static_cast<uint32_t>(_mm256_movemask_epi8(v)); }
+};
+
+using K = VectorKernels<Avx2Ops>;
+
+const scan::Kernels avx2Table = {
+    "avx2", K::skipBlanks, K::skipToNewline, K::skipIdentifier, K::skipDigits, K::skipStringBody,
+    K::lineStarts,
+};
+
+} // namespace
+
+namespace scan {
+
+const Kernels* avx2() {
+    return __builtin_cpu_supports("avx2") ? &avx2Table : nullptr;
+}
+
+} // namespace scan
@@ -0,0 +1,118 @@
+#pragma once
+
+// Kernel bodies shared by the per-ISA translation units. Everything here has
+// internal linkage so that code compiled with -mavx2 can never be picked by
+// the linker for a caller built for the baseline ISA. Nor may a kernel use a
+// standard container: its out-of-line members would be emitted here as weak
+// symbols, and the linker could keep the -mavx2 copy for every caller.
+
+#include "lexer/char_class.h"
+#include <cstddef>
+#include <cstdint>
+
+namespace {
+
+// Local copies of the char_class.h predicates, reading kCharTable directly
+inline bool hasFlag(char c, uint8_t flag) {
+    return kCharTable.entries[static_cast<unsigned char>(c)].flags & flag;
+}
+
+inline bool isBlankByte(char c) { return hasFlag(c, kBlankChar); }
+inline bool isIdentifierByte(char c) { return hasFlag(c, kIdentChar); }
+inline bool isDigitByte(char c) { return hasFlag(c, kDigitChar); }
+
+#ifdef LEXER_SCAN_X86
+
+inline size_t firstBit(uint32_t mask) {
+    return static_cast<size_t>(__builtin_ctz(mask));
+}
+
+// Ops supplies: V, kWidth, kAll, load, splat, eq, range (inclusive, ASCII
+// only), orV and mask (one bit per byte). Each kernel computes a "stop" mask
+// per block and returns at its lowest set bit.
+template <class Ops>
+struct VectorKernels {
+    using V = typename Ops::V;
+
+    static size_t skipBlanks(const char* data, size_t pos, size_t size) {
+        const V space = Ops::splat(' '), tab = Ops::splat('\t');
+        const V cr = Ops::splat('\r'), nl = Ops::splat('\n');
+        while (pos + Ops::kWidth <= size) {
+            V v = Ops::load(data + pos);
+            V blank = Ops::orV(Ops::orV(Ops::eq(v, space), Ops::eq(v, tab)),
+                               Ops::orV(Ops::eq(v, cr), Ops::eq(v, nl)));
+            uint32_t stop = ~Ops::mask(blank) & Ops::kAll;
+            if (stop) return pos + firstBit(stop);
+            pos += Ops::kWidth;
+        }
+        while (pos < size && isBlankByte(data[pos])) pos++;
+        return pos;
+    }
+
+    static size_t skipToNewline(const char* data, size_t pos, size_t size) {
+        const V nl = Ops::splat('\n');
+        while (pos + Ops::kWidth <= size) {
+            uint32_t stop = Ops::mask(Ops::eq(Ops::load(data + pos), nl));
+            if (stop) return pos + firstBit(stop);
+            pos += Ops::kWidth;
+        }
+        while (pos < size && data[pos] != '\n') pos++;
+        return pos;
+    }
+
+    static size_t skipIdentifier(const char* data, size_t pos, size_t size) {
+        const V under = Ops::splat('_');
+        while (pos + Ops::kWidth <= size) {
+            V v = Ops::load(data + pos);
+            V ident = Ops::orV(Ops::orV(Ops::range(v, 'a', 'z'), Ops::range(v, 'A', 'Z')),
+                               Ops::orV(Ops::range(v, '0', '9'), Ops::eq(v, under)));
+            uint32_t stop = ~Ops::mask(ident) & Ops::kAll;
+            if (stop) return pos + firstBit(stop);
+            pos += Ops::kWidth;
+        }
+        while (pos < size && isIdentifierByte(data[pos])) pos++;
+        return pos;
+    }
+
+    static size_t skipDigits(const char* data, size_t pos, size_t size) {
+        while (pos + Ops::kWidth <= size) {
+            V v = Ops::load(data + pos);
+            uint32_t stop = ~Ops::mask(Ops::range(v, '0', '9')) & Ops::kAll;
+            if (stop) return pos + firstBit(stop);
+            pos += Ops::kWidth;
+        }
+        while (pos < size && isDigitByte(data[pos])) pos++;
+        return pos;
+    }
+
+    static size_t skipStringBody(const char* data, size_t pos, size_t size) {
+        const V quote = Ops::splat('"'), nl = Ops::splat('\n');
+        while (pos + Ops::kWidth <= size) {
+            V v = Ops::load(data + pos);
+            uint32_t stop = Ops::mask(Ops::orV(Ops::eq(v, quote), Ops::eq(v, nl)));
+            if (stop) return pos + firstBit(stop);
+            pos += Ops::kWidth;
+        }
+        while (pos < size && data[pos] != '"' && data[pos] != '\n') pos++;
+        return pos;
+    }
+
+    // One compare per block; blocks without a newline cost nothing more
+    static size_t lineStarts(const char* data, size_t pos, size_t size, size_t* out) {
+        const V nl = Ops::splat('\n');
+        size_t count = 0;
+        for (; pos + Ops::kWidth <= size; pos += Ops::kWidth) {
+            for (uint32_t hits = Ops::mask(Ops::eq(Ops::load(data + pos), nl)); hits; hits &= hits - 1) {
+                out[count++] = pos + firstBit(hits) + 1;
+            }
+        }
+        for (; pos < size; ++pos) {
+            if (data[pos] == '\n') out[count++] = pos + 1;
+        }
+        return count;
+    }
+};
+
+#endif // LEXER_SCAN_X86
+
+} // namespace
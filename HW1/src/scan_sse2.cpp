@@ -0,0 +1,40 @@
+#include "lexer/scan.h"
+#include "scan_kernels.h"
+
+#include <emmintrin.h>
+
+namespace {
+
+struct Sse2Ops {
+    using V = __m128i;
+    static constexpr size_t kWidth = 16;
+    static constexpr uint32_t kAll = 0xFFFFu;
+
+    static V load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+    static V splat(char c) { return _mm_set1_epi8(c); }
+    static V eq(V a, V b) { return _mm_cmpeq_epi8(a, b); }
+    static V orV(V a, V b) { return _mm_or_si128(a, b); }
+    // Signed compares: bytes >= 0x80 are negative and never fall in an ASCII range
+    static V range(V v, char lo, char hi) {
+        return _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 1))),
+                             _mm_cmplt_epi8(v, _mm_set1_epi8(static_cast<char>(hi + 1))));
+    }
+    static uint32_t mask(V v) { return static_cast<uint32_t>(_mm_movemask_epi8(v)); }
+};
+
+using K = VectorKernels<Sse2Ops>;
+
+const scan::Kernels sse2Table = {
+    "sse2", K::skipBlanks, K::skipToNewline, K::skipIdentifier, K::skipDigits, K::skipStringBody,
+    K::lineStarts,
+};
+
+} // namespace
+
+namespace scan {
+
+const Kernels* sse2() {
+    return &sse2Table;   // part of the x86-64 baseline
+}
+
+} // namespace scan
@@ -0,0 +1,35 @@
+#include "lexer/stats.h"
+#include <string>
+
+namespace {
+
+const char* const kPhaseNames[RunStats::kPhases] = {"read", "lex", "print", "lex+print"};
+
+std::string tokenName(size_t type) {
+    return tokenTypeToString(static_cast<TokenType>(type));
+}
+
+} // namespace
+
+const char* phaseName(Phase phase) {
+    return kPhaseNames[static_cast<size_t>(phase)];
+}
+
+uint64_t RunStats::tokenCount() const {
+    uint64_t n = 0;
+    for (uint64_t c : tokens) n += c;
+    return n;
+}
+
+void RunStats::merge(const RunStats& other) {
+    PhaseStats::merge(other);
+    for (size_t i = 0; i < kTokenTypes; ++i) tokens[i] += other.tokens[i];
+}
+
+void RunStats::writeText(std::ostream& out) const {
+    PhaseStats::writeText(out, kPhaseNames, kPhases, {{"tokens", tokens, kTokenTypes, tokenName}});
+}
+
+void RunStats::writeJson(std::ostream& out) const {
+    PhaseStats::writeJson(out, kPhaseNames, kPhases, {{"tokens", tokens, kTokenTypes, tokenName}});
+}
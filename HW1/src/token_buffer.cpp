@@ -0,0 +1,43 @@
+#include "lexer/token_buffer.h"
+
+#include <algorithm>
+
+void TokenBuffer::reserve(size_t count) {
+    kinds_.reserve(count);
+    offsets_.reserve(count);
+    lengths_.reserve(count);
+}
+
+void TokenBuffer::resize(size_t count) {
+    kinds_.resize(count, TokenType::END_OF_FILE);
+    offsets_.resize(count, 0);
+    lengths_.resize(count, 0);
+}
+
+void TokenBuffer::clear() {
+    kinds_.clear();
+    offsets_.clear();
+    lengths_.clear();
+}
+
+void TokenBuffer::push_back(const Token& token) {
+    kinds_.push_back(token.type);
+    offsets_.push_back(static_cast<uint32_t>(token.lexeme.data() - source_.data()));
+    lengths_.push_back(static_cast<uint32_t>(token.lexeme.size()));
+}
+
+void TokenBuffer::assign(size_t at, const TokenBuffer& from) {
+    std::copy(from.kinds_.begin(), from.kinds_.end(), kinds_.begin() + at);
+    std::copy(from.offsets_.begin(), from.offsets_.end(), offsets_.begin() + at);
+    std::copy(from.lengths_.begin(), from.lengths_.end(), lengths_.begin() + at);
+}
+
+Position TokenBuffer::position(size_t i) const {
+    if (lines_.lines() == 0) lines_ = LineIndex(source_);
+    return lines_.locate(token(i));
+}
+
+size_t TokenBuffer::memoryBytes() const {
+    return kinds_.capacity() * sizeof(TokenType) + offsets_.capacity() * sizeof(uint32_t) +
+           lengths_.capacity() * sizeof(uint32_t) + lines_.memoryBytes();
+}
@@ -0,0 +1,132 @@
+#include "lexer/token_stream.h"
+
+#include <algorithm>
+#include <cstring>
+#include <istream>
+#include <ostream>
+
+namespace {
+
+template <class T>
+void putLE(char* out, T value) {
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        out[i] = static_cast<char>(static_cast<uint64_t>(value) >> (8 * i));
+    }
+}
+
+template <class T>
+T getLE(const char* in) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < sizeof(T); ++i) {
+        value |= static_cast<uint64_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+    }
+    return static_cast<T>(value);
+}
+
+bool fail(std::string* error, const char* message) {
+    if (error) *error = message;
+    return false;
+}
+
+// Reads `size` bytes into `out`, growing it only as the bytes arrive, so
+// that a damaged size in a header cannot reserve more than the input holds
+template <class Buffer>
+bool readBytes(std::istream& in, Buffer& out, uint64_t size) {
+    constexpr size_t kStep = 1 << 20;
+    out.clear();
+    while (out.size() < size) {
+        size_t at = out.size();
+        size_t step = static_cast<size_t>(std::min<uint64_t>(size - at, kStep));
+        out.resize(at + step);
+        in.read(&out[at], static_cast<std::streamsize>(step));
+        if (static_cast<size_t>(in.gcount()) != step) return false;
+    }
+    return true;
+}
+
+} // namespace
+
+void TokenStreamWriter::add(const Token& token, Position position) {
+    char record[kTokenRecordSize] = {};
+    putLE<uint8_t>(record, static_cast<uint8_t>(token.type));
+    putLE<uint32_t>(record + 4, static_cast<uint32_t>(position.line));
+    putLE<uint32_t>(record + 8, static_cast<uint32_t>(position.column));
+    putLE<uint32_t>(record + 12, static_cast<uint32_t>(blob_.size()));
+    putLE<uint32_t>(record + 16, static_cast<uint32_t>(token.lexeme.size()));
+    records_.append(record, sizeof record);
+    blob_.append(token.lexeme.data(), token.lexeme.size());
+    count_++;
+}
+
+void TokenStreamWriter::header(char* out) const {
+    std::memcpy(out, kTokenStreamMagic, 4);
+    putLE<uint16_t>(out + 4, kTokenStreamVersion);
+    putLE<uint16_t>(out + 6, static_cast<uint16_t>(kTokenRecordSize));
+    putLE<uint64_t>(out + 8, count_);
+    putLE<uint64_t>(out + 16, blob_.size());
+}
+
+void TokenStreamWriter::clear() {
+    records_.clear();
+    blob_.clear();
+    count_ = 0;
+}
+
+void TokenStreamWriter::write(std::ostream& out) {
+    char head[kTokenStreamHeaderSize];
+    header(head);
+    out.write(head, sizeof head);
+    out.write(records_.data(), static_cast<std::streamsize>(records_.size()));
+    out.write(blob_.data(), static_cast<std::streamsize>(blob_.size()));
+    clear();
+}
+
+void TokenStreamWriter::write(std::string& out) {
+    char head[kTokenStreamHeaderSize];
+    header(head);
+    out.reserve(out.size() + sizeof head + records_.size() + blob_.size());
+    out.append(head, sizeof head);
+    out += records_;
+    out += blob_;
+    clear();
+}
+
+bool readTokenStream(std::istream& in, TokenStream& stream, std::string* error) {
+    stream.tokens.clear();
+    stream.positions.clear();
+    stream.blob.clear();
+    if (error) error->clear();
+
+    char header[kTokenStreamHeaderSize];
+    in.read(header, sizeof header);
+    if (in.gcount() == 0) return false;
+    if (static_cast<size_t>(in.gcount()) != sizeof header) return fail(error, "truncated header");
+    if (std::memcmp(header, kTokenStreamMagic, 4) != 0) return fail(error, "not a token stream");
+    if (getLE<uint16_t>(header + 4) != kTokenStreamVersion) return fail(error, "unsupported version");
+    if (getLE<uint16_t>(header + 6) != kTokenRecordSize) return fail(error, "unsupported record size");
+    uint64_t count = getLE<uint64_t>(header + 8);
+    uint64_t blobSize = getLE<uint64_t>(header + 16);
+    if (blobSize > kTokenStreamMaxBlob || count > (uint64_t(1) << 40) / kTokenRecordSize) {
+        return fail(error, "stream too large");
+    }
+
+    std::string records;
+    if (!readBytes(in, records, count * kTokenRecordSize)) return fail(error, "truncated records");
+    if (!readBytes(in, stream.blob, blobSize)) return fail(error, "truncated lexeme blob");
+
+    stream.tokens.reserve(static_cast<size_t>(count));
+    stream.positions.reserve(static_cast<size_t>(count));
+    for (size_t i = 0; i < count; ++i) {
+        const char* record = records.data() + i * kTokenRecordSize;
+        uint8_t type = getLE<uint8_t>(record);
+        uint32_t offset = getLE<uint32_t>(record + 12);
+        uint32_t length = getLE<uint32_t>(record + 16);
+        if (type > static_cast<uint8_t>(TokenType::ERROR)) return fail(error, "bad token type");
+        if (offset > blobSize || length > blobSize - offset) return fail(error, "lexeme outside the blob");
+        stream.tokens.push_back(Token{static_cast<TokenType>(type),
+                                      std::string_view(stream.blob.data() + offset, length)});
+        stream.positions.push_back(Position{static_cast<int>(getLE<uint32_t>(record + 4)),
+                                            static_cast<int>(getLE<uint32_t>(record + 8))});
+    }
+    return true;
+}
@@ -1,5 +1,16 @@
+#include "common/batch.h"
+#include "common/trace.h"
+#include "lexer/incremental.h"
 #include "lexer/lexer.h"
+#include "lexer/line_index.h"
+#include "lexer/parallel_lexer.h"
+#include "lexer/scan.h"
+#include "lexer/stats.h"
+#include "lexer/token_buffer.h"
+#include "lexer/token_stream.h"
+#include <atomic>
 #include <iostream>
+#include <sstream>
 #include <string>
 #include <cstring>
 #include <vector>
@@ -130,8 +141,643 @@ void test_edge_eq() {
     ASSERT_EQ(std::string("=="), tokens[0].lexeme);
 }
 
+void test_zero_copy() {
+    // Lexemes are views into the caller's buffer, not copies
+    std::string source = "let name = \"hi\"; x == 1";
+    Lexer lexer(source);
+    auto tokens = lexer.tokenize();
+    ASSERT_EQ(9u, tokens.size());
+    for (const auto& tok : tokens) {
+        ASSERT_EQ(true, tok.lexeme.data() >= source.data());
+        ASSERT_EQ(true, tok.lexeme.data() + tok.lexeme.size() <= source.data() + source.size());
+    }
+    ASSERT_EQ(source.data() + 4, tokens[1].lexeme.data());
+    ASSERT_EQ(std::string("hi"), tokens[3].lexeme);
+    ASSERT_EQ(source.data() + 12, tokens[3].lexeme.data());
+    ASSERT_EQ(std::string("=="), tokens[6].lexeme);
+    ASSERT_EQ(TokenType::END_OF_FILE, tokens[8].type);
+    ASSERT_EQ(0u, tokens[8].lexeme.size());
+
+    // Unterminated strings keep their opening quote
+    Lexer lexer2("\"open");
+    auto t2 = lexer2.tokenize();
+    ASSERT_EQ(TokenType::ERROR, t2[0].type);
+    ASSERT_EQ(std::string("\"open"), t2[0].lexeme);
+}
+
+void test_cooked_string() {
+    Lexer lexer("\"a\\tb\\n\" x");
+    auto tokens = lexer.tokenize();
+    ASSERT_EQ(TokenType::STRING, tokens[0].type);
+    ASSERT_EQ(std::string("a\\tb\\n"), tokens[0].lexeme);
+    ASSERT_EQ(std::string("a\tb\n"), tokens[0].cooked());
+    ASSERT_EQ(std::string("x"), tokens[1].cooked());
+}
+
+void test_next_token() {
+    // Pulling tokens one at a time matches tokenize()
+    const char* source = "fn main() { let x = \"s\"; } // done";
+    auto all = Lexer(source).tokenize();
+    Lexer lexer(source);
+    for (const auto& expected : all) {
+        Token tok = lexer.nextToken();
+        ASSERT_EQ(expected.type, tok.type);
+        ASSERT_EQ(expected.lexeme, tok.lexeme);
+        ASSERT_EQ(true, expected.start() == tok.start());
+    }
+    // EOF is sticky
+    ASSERT_EQ(TokenType::END_OF_FILE, lexer.nextToken().type);
+}
+
+void test_keyword_near_miss() {
+    // Words that share a length or prefix with a keyword are identifiers
+    Lexer lexer("f fnx iff lets mu mutt els elses whil whiles retur returns Fn IF r3turn");
+    auto tokens = lexer.tokenize();
+    ASSERT_EQ(16u, tokens.size()); // 15 identifiers + EOF
+    for (size_t i = 0; i + 1 < tokens.size(); ++i) {
+        ASSERT_EQ(TokenType::IDENTIFIER, tokens[i].type);
+    }
+}
+
+void test_scan_kernels() {
+    // Every SIMD kernel agrees with the scalar one from every start offset,
+    // including runs that end inside and after a full vector block
+    std::string buf;
+    const char pieces[][48] = {
+        "   \t\r\n  ", "// comment text that runs on\n", "ident_123_xyz_ABCdef_long_name_here",
+        "0123456789012345678901234567890123", "\"string body with // inside\"", "{(;:,+-*/<=>)}",
+        "\xc3\xa9\xff\x80 ", "a", "\n\n\n",
+    };
+    for (int i = 0; i < 200; ++i) buf += pieces[(i * 7 + i / 3) % 9];
+
+    const scan::Kernels& ref = scan::scalar();
+    for (const scan::Kernels* k : {scan::sse2(), scan::avx2()}) {
+        if (!k) continue;
+        const char* d = buf.data();
+        for (size_t pos = 0; pos <= buf.size(); ++pos) {
+            ASSERT_EQ(ref.skipBlanks(d, pos, buf.size()), k->skipBlanks(d, pos, buf.size()));
+            ASSERT_EQ(ref.skipToNewline(d, pos, buf.size()), k->skipToNewline(d, pos, buf.size()));
+            ASSERT_EQ(ref.skipIdentifier(d, pos, buf.size()), k->skipIdentifier(d, pos, buf.size()));
+            ASSERT_EQ(ref.skipDigits(d, pos, buf.size()), k->skipDigits(d, pos, buf.size()));
+            ASSERT_EQ(ref.skipStringBody(d, pos, buf.size()), k->skipStringBody(d, pos, buf.size()));
+        }
+        for (size_t size : {size_t(0), size_t(15), size_t(33), size_t(100), buf.size()}) {
+            for (size_t pos : {size_t(0), size_t(7)}) {
+                if (pos > size) continue;
+                std::vector<size_t> expected(size - pos), actual(size - pos);
+                expected.resize(ref.lineStarts(d, pos, size, expected.data()));
+                actual.resize(k->lineStarts(d, pos, size, actual.data()));
+                ASSERT_EQ(true, expected == actual);
+            }
+        }
+    }
+
+    // Positions across long whitespace, comment and multi-line string runs
+    const char* source = "x\n\n      \t  // c c c c c c c c c c c c c c c c c c c c c c\n   \"ab\ncd\" y";
+    auto tokens = Lexer(source).tokenize();
+    LineIndex lines(source);
+    ASSERT_EQ(4u, tokens.size());
+    ASSERT_EQ(4, lines.locate(tokens[1]).line);
+    ASSERT_EQ(4, lines.locate(tokens[1]).column);
+    ASSERT_EQ(5, lines.locate(tokens[2]).line);
+    ASSERT_EQ(5, lines.locate(tokens[2]).column);
+}
+
+void test_char_table() {
+    // Every byte on its own lexes as the locale-independent ASCII rules say
+    for (int b = 1; b < 256; ++b) {
+        char c = static_cast<char>(b);
+        std::string source(1, c);
+        Lexer lexer(source);
+        Token tok = lexer.nextToken();
+        TokenType expected = TokenType::ERROR;
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n') expected = TokenType::END_OF_FILE;
+        else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_') expected = TokenType::IDENTIFIER;
+        else if (c >= '0' && c <= '9') expected = TokenType::INTEGER;
+        else if (c == '"') expected = TokenType::ERROR;   // unterminated string
+        else {
+            const char* ops = "+-*/=<>(){};:,";
+            const TokenType types[] = {
+                TokenType::PLUS, TokenType::MINUS, TokenType::STAR, TokenType::SLASH,
+                TokenType::ASSIGN, TokenType::LT, TokenType::GT, TokenType::LPAREN,
+                TokenType::RPAREN, TokenType::LBRACE, TokenType::RBRACE, TokenType::SEMICOLON,
+                TokenType::COLON, TokenType::COMMA,
+            };
+            for (int i = 0; ops[i]; ++i) {
+                if (ops[i] == c) expected = types[i];
+            }
+        }
+        ASSERT_EQ(expected, tok.type);
+        if (expected != TokenType::END_OF_FILE) {
+            ASSERT_EQ(1u, tok.lexeme.size());
+            ASSERT_EQ(TokenType::END_OF_FILE, lexer.nextToken().type);
+        }
+    }
+}
+
+void test_batch_pool() {
+    // Every task runs exactly once whatever the worker count, and the
+    // ordered writer emits results by index even when they finish backwards
+    const size_t count = 200;
+    for (unsigned threads : {1u, 4u}) {
+        WorkStealingPool pool(threads);
+        std::vector<std::atomic<int>> runs(count);
+        std::vector<size_t> order;
+        for (size_t i = count; i-- > 0;) order.push_back(i);
+        std::ostringstream out, err;
+        OrderedWriter writer(count, out, err);
+        pool.run(order, [&](size_t index, unsigned worker) {
+            runs[index]++;
+            if (worker >= threads) runs[index] += 100;
+            writer.publish(index, std::to_string(index) + ",", index % 50 == 0 ? "e" : "");
+        });
+
+        std::string expected;
+        for (size_t i = 0; i < count; ++i) {
+            ASSERT_EQ(1, runs[i].load());
+            expected += std::to_string(i) + ",";
+        }
+        ASSERT_EQ(expected, out.str());
+        ASSERT_EQ(std::string("eeee"), err.str());
+    }
+
+    // A single worker keeps input order; several start with the largest file
+    std::vector<std::string> paths = {"/nonexistent-a", "/nonexistent-b"};
+    ASSERT_EQ(0u, batchOrder(paths, 1)[0]);
+    ASSERT_EQ(1u, batchOrder(paths, 1)[1]);
+    ASSERT_EQ(0u, batchOrder(paths, 4)[0]);
+
+    // --jobs=N takes a plain thread count within kMaxJobs
+    unsigned jobs = 7;
+    ASSERT_EQ(true, parseJobs("0", jobs));
+    ASSERT_EQ(0u, jobs);
+    ASSERT_EQ(true, parseJobs("1024", jobs));
+    ASSERT_EQ(1024u, jobs);
+    for (const char* bad : {"", "abc", "-1", "4x", " 4", "1025", "99999999999"}) {
+        ASSERT_EQ(false, parseJobs(bad, jobs));
+    }
+    ASSERT_EQ(1024u, jobs);
+}
+
+static std::string describe(const std::vector<Token>& tokens, const std::vector<Position>& positions) {
+    std::string out;
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        out += std::to_string(positions[i].line) + ":" + std::to_string(positions[i].column) + " " +
+               tokenTypeToString(tokens[i].type) + " [" + tokens[i].text() + "]\n";
+    }
+    return out;
+}
+
+// Tokens viewing `source`, with their positions looked up
+static std::string describe(const std::vector<Token>& tokens, std::string_view source) {
+    LineIndex lines(source);
+    std::vector<Position> positions;
+    for (const Token& t : tokens) positions.push_back(lines.locate(t));
+    return describe(tokens, positions);
+}
+
+void test_parallel_tokenize() {
+    // Tiny chunks put boundaries inside multi-line strings, right after
+    // comments containing quotes, and inside an unterminated final string
+    const char* fixed =
+        "let s = \"one\ntwo\nthree\"; // a \"quote\n"
+        "fn f() { x / y // \"\n  \"\n\" }\n"
+        "\n\n   \n"
+        "let t = \"open\n\nto the end";
+    std::vector<std::string> inputs = {fixed, "", "\n", "a\nb", "\"\n\n\"", "// only\n   \n"};
+
+    // Plus pseudo-random soup over the characters that matter
+    const char alphabet[] = "ab1 \n\n\"\"//=+;";
+    uint32_t seed = 12345;
+    for (int n = 0; n < 40; ++n) {
+        std::string text;
+        for (int i = 0; i < 300; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            text += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+        }
+        inputs.push_back(text);
+    }
+
+    for (const std::string& input : inputs) {
+        std::string expected = describe(Lexer(input).tokenize(), input);
+        for (size_t chunk : {1, 2, 3, 7, 16, 64}) {
+            ASSERT_EQ(expected, describe(tokenizeParallel(input, 4, chunk), input));
+        }
+        ASSERT_EQ(expected, describe(tokenizeParallel(input, 1, 5), input));
+    }
+
+    // Lexemes still view the caller's buffer
+    std::string input = fixed;
+    auto tokens = tokenizeParallel(input, 2, 8);
+    ASSERT_EQ(true, tokens[3].lexeme.data() > input.data());
+    ASSERT_EQ(true, tokens[3].lexeme.data() < input.data() + input.size());
+}
+
+static std::string kindsAndText(const std::vector<Token>& tokens, size_t begin, size_t end) {
+    std::string out;
+    for (size_t i = begin; i < end; ++i) {
+        out += tokenTypeToString(tokens[i].type) + " [" + tokens[i].text() + "]\n";
+    }
+    return out;
+}
+
+void test_incremental_relex() {
+    const char alphabet[] = "ab1 \n\n\"\"//=+;<";
+    uint32_t seed = 777;
+    auto next = [&](uint32_t bound) {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) % bound;
+    };
+
+    for (int n = 0; n < 300; ++n) {
+        std::string before;
+        size_t size = next(120);
+        for (size_t i = 0; i < size; ++i) before += alphabet[next(sizeof(alphabet) - 1)];
+        TextEdit edit;
+        edit.offset = next(static_cast<uint32_t>(before.size() + 1));
+        edit.oldLength = next(static_cast<uint32_t>(std::min<size_t>(before.size() - edit.offset, 6) + 1));
+        edit.newLength = n % 3 == 0 ? edit.oldLength : next(6);
+        std::string inserted;
+        for (size_t i = 0; i < edit.newLength; ++i) inserted += alphabet[next(sizeof(alphabet) - 1)];
+
+        // Once into a fresh buffer, once edited in place
+        for (bool inPlace : {false, true}) {
+            std::string old = before;
+            old.reserve(256);
+            std::vector<Token> tokens = Lexer(old).tokenize();
+            std::vector<Token> original = tokens;
+            std::string_view oldView = old;
+            std::string copy;
+            std::string& after = inPlace ? old : copy;
+            after = before;
+            after.replace(edit.offset, edit.oldLength, inserted);
+
+            TokenChange change = relex(tokens, oldView, after, edit);
+            std::vector<Token> expected = Lexer(after).tokenize();
+            ASSERT_EQ(describe(expected, after), describe(tokens, after));
+            ASSERT_EQ(true, tokens.back().lexeme.data() == after.data() + after.size());
+
+            // Everything outside the reported range kept its type and text
+            ASSERT_EQ(original.size() - change.oldCount, tokens.size() - change.newCount);
+            size_t tail = original.size() - change.first - change.oldCount;
+            ASSERT_EQ(kindsAndText(expected, 0, change.first),
+                      kindsAndText(tokens, 0, change.first));
+            ASSERT_EQ(kindsAndText(expected, expected.size() - tail, expected.size()),
+                      kindsAndText(tokens, tokens.size() - tail, tokens.size()));
+        }
+    }
+
+    // One changed token in the middle is reported as exactly that token
+    std::string old = "let a = 1;\nlet b = 2;\nlet c = 3;\n";
+    std::vector<Token> tokens = Lexer(old).tokenize();
+    std::string text = old;
+    text.replace(text.find("b"), 1, "bee");
+    TokenChange change = relex(tokens, old, text, TextEdit{15, 1, 3});
+    ASSERT_EQ(6u, change.first);
+    ASSERT_EQ(1u, change.oldCount);
+    ASSERT_EQ(1u, change.newCount);
+    ASSERT_EQ(std::string("bee"), tokens[6].text());
+    LineIndex lines(text);
+    ASSERT_EQ(2, lines.locate(tokens[7]).line);
+    ASSERT_EQ(9, lines.locate(tokens[7]).column);
+    ASSERT_EQ(3, lines.locate(tokens[11]).line);
+    ASSERT_EQ(5, lines.locate(tokens[11]).column);
+}
+
+// The change relex() should report, found by diffing two full lexes: the
+// longest runs of equal tokens at the front and back, where a token only
+// counts as equal if none of its bytes were replaced
+static TokenChange diffTokens(const std::vector<Token>& before, std::string_view oldSource,
+                              const std::vector<Token>& after, std::string_view newSource, const TextEdit& edit) {
+    auto span = [](const Token& t, std::string_view source) {
+        size_t quote = t.type == TokenType::STRING ? 1 : 0;
+        size_t start = static_cast<size_t>(t.lexeme.data() - source.data()) - quote;
+        return std::make_pair(start, start + t.lexeme.size() + 2 * quote);
+    };
+    auto equal = [](const Token& a, const Token& b) { return a.type == b.type && a.lexeme == b.lexeme; };
+    size_t front = 0;
+    while (front < before.size() && front < after.size() && equal(before[front], after[front]) &&
+           span(before[front], oldSource).second <= edit.offset &&
+           span(before[front], oldSource).first == span(after[front], newSource).first) {
+        front++;
+    }
+    size_t back = 0;
+    while (back < before.size() - front && back < after.size() - front) {
+        const Token& a = before[before.size() - 1 - back];
+        const Token& b = after[after.size() - 1 - back];
+        size_t start = span(a, oldSource).first;
+        if (!equal(a, b) || start < edit.offset + edit.oldLength ||
+            span(b, newSource).first != start - edit.oldLength + edit.newLength) {
+            break;
+        }
+        back++;
+    }
+    return {front, before.size() - front - back, after.size() - front - back};
+}
+
+void test_relex_change() {
+    // A deletion that leaves an old token's type, length and shifted offset
+    // behind: "x" was deleted, so it is part of the change
+    std::string old = "fn(x";
+    std::vector<Token> tokens = Lexer(old).tokenize();
+    TokenChange change = relex(tokens, old, "f", TextEdit{1, 3, 0});
+    ASSERT_EQ(0u, change.first);
+    ASSERT_EQ(3u, change.oldCount);
+    ASSERT_EQ(1u, change.newCount);
+
+    const char alphabet[] = "ab1 \n\"\"//=+;<({";
+    uint32_t seed = 4242;
+    auto next = [&](uint32_t bound) {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) % bound;
+    };
+    for (int n = 0; n < 2000; ++n) {
+        std::string before;
+        size_t size = next(60);
+        for (size_t i = 0; i < size; ++i) before += alphabet[next(sizeof(alphabet) - 1)];
+        TextEdit edit;
+        edit.offset = next(static_cast<uint32_t>(before.size() + 1));
+        edit.oldLength = next(static_cast<uint32_t>(std::min<size_t>(before.size() - edit.offset, 6) + 1));
+        edit.newLength = next(6);
+        std::string after = before;
+        std::string inserted;
+        for (size_t i = 0; i < edit.newLength; ++i) inserted += alphabet[next(sizeof(alphabet) - 1)];
+        // Sometimes put back what was there, or a part of it
+        if (n % 4 == 0) inserted = before.substr(edit.offset, edit.newLength);
+        edit.newLength = inserted.size();
+        after.replace(edit.offset, edit.oldLength, inserted);
+
+        std::vector<Token> original = Lexer(before).tokenize();
+        std::vector<Token> tokens = original;
+        TokenChange change = relex(tokens, before, after, edit);
+        TokenChange expected = diffTokens(original, before, Lexer(after).tokenize(), after, edit);
+        ASSERT_EQ(expected.oldCount, change.oldCount);
+        ASSERT_EQ(expected.newCount, change.newCount);
+        // An empty change, e.g. text put back as it was, has no position
+        if (expected.oldCount + expected.newCount > 0) ASSERT_EQ(expected.first, change.first);
+    }
+}
+
+void test_token_stream() {
+    std::string first = "fn main() {\n  let s = \"two\nlines\"; // note\n  x >= 10 @\n}\n";
+    std::string second = "";
+    std::vector<Token> a = Lexer(first).tokenize();
+    std::vector<Token> b = Lexer(second).tokenize();
+
+    // Two streams back to back, one of them written into a string
+    std::ostringstream out;
+    TokenStreamWriter writer;
+    LineIndex linesA(first), linesB(second);
+    for (const Token& t : a) writer.add(t, linesA.locate(t));
+    ASSERT_EQ(a.size(), writer.size());
+    writer.write(out);
+    for (const Token& t : b) writer.add(t, linesB.locate(t));
+    std::string tail;
+    writer.write(tail);
+    out << tail;
+    std::string bytes = out.str();
+    size_t blob = 0;
+    for (const Token& t : a) blob += t.lexeme.size();
+    ASSERT_EQ(kTokenStreamHeaderSize * 2 + kTokenRecordSize * (a.size() + b.size()) + blob, bytes.size());
+    ASSERT_EQ(std::string("RLXT"), bytes.substr(0, 4));
+
+    std::istringstream in(bytes);
+    TokenStream stream;
+    std::string error;
+    ASSERT_EQ(true, readTokenStream(in, stream, &error));
+    ASSERT_EQ(describe(a, first), describe(stream.tokens, stream.positions));
+    ASSERT_EQ(true, readTokenStream(in, stream, &error));
+    ASSERT_EQ(describe(b, second), describe(stream.tokens, stream.positions));
+    ASSERT_EQ(false, readTokenStream(in, stream, &error));
+    ASSERT_EQ(std::string(), error);
+
+    // Damaged streams are rejected with a reason
+    std::string damaged = bytes;
+    damaged[4] = 9;
+    std::istringstream badVersion(damaged);
+    ASSERT_EQ(false, readTokenStream(badVersion, stream, &error));
+    ASSERT_EQ(std::string("unsupported version"), error);
+    std::istringstream truncated(bytes.substr(0, 100));
+    ASSERT_EQ(false, readTokenStream(truncated, stream, &error));
+    ASSERT_EQ(std::string("truncated records"), error);
+    // A huge count is only believed as far as the records are there
+    damaged = bytes.substr(0, 100);
+    damaged[8 + 3] = 0x7f;
+    std::istringstream hugeCount(damaged);
+    ASSERT_EQ(false, readTokenStream(hugeCount, stream, &error));
+    ASSERT_EQ(std::string("truncated records"), error);
+    damaged = bytes;
+    damaged[kTokenStreamHeaderSize + 16] = 127;
+    std::istringstream badLength(damaged);
+    ASSERT_EQ(false, readTokenStream(badLength, stream, &error));
+    ASSERT_EQ(std::string("lexeme outside the blob"), error);
+}
+
 // ---- Test runner ----
 
+static std::vector<Token> expand(const TokenBuffer& buffer) {
+    std::vector<Token> tokens;
+    for (size_t i = 0; i < buffer.size(); ++i) tokens.push_back(buffer.token(i));
+    return tokens;
+}
+
+void test_token_buffer() {
+    ASSERT_EQ(1u, sizeof(TokenType));
+
+    // Strings (position at the quote, lexeme after it), multi-line and
+    // unterminated strings, CRLF, leading blank lines and EOF after them
+    std::vector<std::string> inputs = {
+        "", "\n\n", "fn main() {\n    let s = \"a\nb\";\r\n    x >= 10; // c\n}\n",
+        "\n\n  \"one\"\"two\" @ \"open\n\nend",
+    };
+    uint32_t seed = 99;
+    const char alphabet[] = "ab1 \n\"/=;";
+    for (int n = 0; n < 20; ++n) {
+        std::string text;
+        for (int i = 0; i < 200; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            text += alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+        }
+        inputs.push_back(text);
+    }
+
+    for (const std::string& input : inputs) {
+        std::vector<Token> expected = Lexer(input).tokenize();
+        TokenBuffer buffer(input);
+        ASSERT_EQ(true, Lexer(input).tokenize(buffer));
+        ASSERT_EQ(expected.size(), buffer.size());
+        ASSERT_EQ(describe(expected, input), describe(expand(buffer), input));
+        LineIndex lines(input);
+        for (size_t i = 0; i < expected.size() && i < buffer.size(); ++i) {
+            ASSERT_EQ(true, buffer.kinds()[i] == expected[i].type);
+            ASSERT_EQ(true, buffer.lexeme(i).data() == expected[i].lexeme.data());
+            ASSERT_EQ(lines.locate(expected[i]).line, buffer.position(i).line);
+            ASSERT_EQ(lines.locate(expected[i]).column, buffer.position(i).column);
+        }
+
+        TokenBuffer parallel;
+        ASSERT_EQ(true, tokenizeParallel(input, parallel, 3, 7));
+        ASSERT_EQ(describe(expected, input), describe(expand(parallel), input));
+    }
+
+    // 9 bytes per token plus the line table, against 24 per Token; both
+    // grow the same way, so compare what they actually hold
+    std::string big;
+    for (int i = 0; i < 2000; ++i) big += "let x = a + 1;\n";
+    std::vector<Token> wide = Lexer(big).tokenize();
+    TokenBuffer buffer(big);
+    Lexer(big).tokenize(buffer);
+    buffer.position(0);
+    ASSERT_EQ(true, buffer.memoryBytes() * 2 < wide.capacity() * sizeof(Token));
+}
+
+void test_line_index() {
+    // Every offset, with and without hints, against a byte-by-byte count
+    std::string source = "ab\n\n\ncd ef\r\n";
+    for (int i = 0; i < 40; ++i) source += std::string(i % 7, 'x') + (i % 3 ? "\n" : " ");
+    LineIndex lines(source);
+    int line = 1, column = 1;
+    size_t hint = 0, staleHint = 3;
+    for (size_t offset = 0; offset <= source.size(); ++offset) {
+        Position plain = lines.locate(offset);
+        Position hinted = lines.locate(offset, hint);
+        Position stale = lines.locate(source.size() - offset, staleHint);
+        Position back = lines.locate(source.size() - offset);
+        ASSERT_EQ(line, plain.line);
+        ASSERT_EQ(column, plain.column);
+        ASSERT_EQ(line, hinted.line);
+        ASSERT_EQ(column, hinted.column);
+        ASSERT_EQ(back.line, stale.line);
+        ASSERT_EQ(back.column, stale.column);
+        if (offset < source.size() && source[offset] == '\n') {
+            line++;
+            column = 1;
+        } else {
+            column++;
+        }
+    }
+    ASSERT_EQ(static_cast<size_t>(line), lines.lines());
+
+    // An empty source is one empty line
+    LineIndex empty("");
+    ASSERT_EQ(1u, empty.lines());
+    ASSERT_EQ(1, empty.locate(0).line);
+    ASSERT_EQ(1, empty.locate(0).column);
+}
+
+void test_run_stats() {
+    if (!kStatsEnabled) return;  // counting compiles to nothing
+
+    // Token counts and `{` depth, reset per file; a stray `}` does not
+    // count as closing below zero
+    RunStats a;
+    a.beginFile(10);
+    for (const Token& t : Lexer("} fn f() { if x { } { { } } }").tokenize()) a.count(t);
+    RunStats b;
+    b.beginFile(5);
+    for (const Token& t : Lexer("{ let y = 1; }").tokenize()) b.count(t);
+    ASSERT_EQ(3u, a.maxDepth);
+    ASSERT_EQ(1u, b.maxDepth);
+    ASSERT_EQ(5u, static_cast<unsigned>(a.tokens[static_cast<size_t>(TokenType::RBRACE)]));
+
+    a[Phase::Lex].wall = 0.5;
+    b[Phase::Lex].wall = 0.25;
+    a.merge(b);
+    ASSERT_EQ(2u, static_cast<unsigned>(a.files));
+    ASSERT_EQ(15u, static_cast<unsigned>(a.bytes));
+    ASSERT_EQ(3u, a.maxDepth);
+    ASSERT_EQ(0.75, a[Phase::Lex].wall);
+    ASSERT_EQ(2u, static_cast<unsigned>(a.tokens[static_cast<size_t>(TokenType::END_OF_FILE)]));
+    ASSERT_EQ(24u, static_cast<unsigned>(a.tokenCount()));
+
+    std::ostringstream json;
+    a.writeJson(json);
+    ASSERT_EQ(0u, json.str().find("{\"files\":2,\"bytes\":15,\"phases\":{\"read\":"));
+    ASSERT_EQ(true, json.str().find("\"tokens\":{\"total\":24,\"KW_FN\":1,") != std::string::npos);
+    ASSERT_EQ(true, json.str().find("\"max_depth\":3}\n") != std::string::npos);
+    std::ostringstream text;
+    a.writeText(text);
+    ASSERT_EQ(true, text.str().find("files 2, 15 bytes") != std::string::npos);
+
+    // A timer adds to its phase, and a null one does nothing
+    RunStats timed;
+    {
+        PhaseTimer timer(&timed, Phase::Print);
+        PhaseTimer none(nullptr, Phase::Print);
+        volatile unsigned spin = 0;
+        while (spin < 100000) spin = spin + 1;
+    }
+    ASSERT_EQ(true, timed[Phase::Print].wall > 0);
+    ASSERT_EQ(true, timed[Phase::Print].cpu > 0);
+    ASSERT_EQ(0.0, timed[Phase::Read].wall);
+}
+
+void test_trace() {
+    if (!kStatsEnabled) return;  // the tracer compiles to nothing
+
+    std::string input;
+    for (int i = 0; i < 16; ++i) input += "let x = \"s\";\n";
+    tokenizeParallel(input, 2, 8);  // not recorded yet
+    Tracer::start("rustc");
+    {
+        TraceSpan span("file", "a \"b\"\\c\n");
+        tokenizeParallel(input, 2, 8);
+    }
+
+    std::ostringstream out;
+    Tracer::write(out);
+    std::string json = out.str();
+    auto count = [&](const std::string& text) {
+        size_t n = 0;
+        for (size_t at = json.find(text); at != std::string::npos; at = json.find(text, at + 1)) n++;
+        return n;
+    };
+    // Every chunk is summarized, lexed and placed once, on whichever of the
+    // pool's threads takes it
+    size_t chunks = count("{\"name\":\"lex chunk\",\"cat\":\"rustc\",\"ph\":\"X\",");
+    ASSERT_EQ(true, chunks >= 16);
+    ASSERT_EQ(chunks, count("\"name\":\"summarize chunk\""));
+    ASSERT_EQ(chunks, count("\"name\":\"place chunk\""));
+    ASSERT_EQ(0u, json.find("{\"traceEvents\":[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                            "\"args\":{\"name\":\"main\"}}"));
+    ASSERT_EQ(1u, count("\"args\":{\"detail\":\"a \\\"b\\\"\\\\c\\u000a\"}"));
+}
+
+void test_alloc_stats() {
+    if (!kAllocStatsEnabled) return;  // operator new is the library's
+
+    // Allocations count towards the phase whose timer runs on this thread,
+    // and only while it runs
+    const size_t lex = static_cast<size_t>(Phase::Lex);
+    RunStats stats;
+    uint64_t before = allocReport(RunStats::kPhases)[lex].count;
+    std::vector<int>* kept;
+    {
+        PhaseTimer timer(&stats, Phase::Lex);
+        kept = new std::vector<int>(1000);
+        PhaseTimer total(&stats.total);  // no phase of its own
+        std::vector<char> scratch(50000);
+    }
+    std::vector<char> after(70000);
+    std::vector<PhaseAllocs> report = allocReport(RunStats::kPhases);
+    ASSERT_EQ(static_cast<size_t>(RunStats::kPhases + 1), report.size());
+    ASSERT_EQ(3u, static_cast<unsigned>(report[lex].count - before));
+    ASSERT_EQ(true, report[lex].bytes >= sizeof(std::vector<int>) + 4000 + 50000);
+    ASSERT_EQ(true, report[lex].bytes < 70000);
+    ASSERT_EQ(true, report[lex].peakLive >= 54000);
+    ASSERT_EQ(false, report[lex].sites.empty());
+    ASSERT_EQ(true, report[RunStats::kPhases].count > 0);
+    delete kept;
+
+    std::ostringstream json;
+    stats.writeJson(json);
+    ASSERT_EQ(true, json.str().find("\"allocations\":{\"read\":{\"count\":") != std::string::npos);
+    ASSERT_EQ(true, json.str().find("\"lex\":{\"count\":") != std::string::npos);
+    std::ostringstream text;
+    stats.writeText(text);
+    ASSERT_EQ(true, text.str().find("top sites, lex\n") != std::string::npos);
+}
+
 struct TestEntry {
     const char* name;
     void (*func)();
@@ -147,6 +793,22 @@ static TestEntry all_tests[] = {
     {"whitespace_comments", test_whitespace_comments},
     {"edge_fn_name",        test_edge_fn_name},
     {"edge_eq",             test_edge_eq},
+    {"zero_copy",           test_zero_copy},
+    {"cooked_string",       test_cooked_string},
+    {"next_token",          test_next_token},
+    {"keyword_near_miss",   test_keyword_near_miss},
+    {"scan_kernels",        test_scan_kernels},
+    {"char_table",          test_char_table},
+    {"batch_pool",          test_batch_pool},
+    {"parallel_tokenize",   test_parallel_tokenize},
+    {"incremental_relex",   test_incremental_relex},
+    {"relex_change",        test_relex_change},
+    {"token_stream",        test_token_stream},
+    {"token_buffer",        test_token_buffer},
+    {"line_index",          test_line_index},
+    {"run_stats",           test_run_stats},
+    {"trace",               test_trace},
+    {"alloc_stats",         test_alloc_stats},
 };
 
 int main(int argc, char* argv[]) {
@@ -0,0 +1,97 @@
+// Throughput of the lexer, both parsers and AST printing on generated
+// corpora, one JSON line per measurement. The corpus generator and the
+// report format are shared with the HW1 suite (HW1/bench), so the lexer
+// numbers of the two are directly comparable.
+//
+//   bench_suite [--sizes=1K,64K,1M,16M] [--repeat=N] [generator flags]
+
+#include "bench_report.h"
+#include "corpus_gen.h"
+#include "flat_ast.h"
+#include "lexer.h"
+#include "output.h"
+#include "parser.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+int main(int argc, char* argv[]) {
+    bench::CorpusOptions options;
+    std::vector<size_t> sizes = {1 << 10, 64 << 10, 1 << 20, 16 << 20};
+    int repeat = 5;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg.compare(0, 8, "--sizes=") == 0) {
+            sizes.clear();
+            std::istringstream list(arg.substr(8));
+            for (std::string item; std::getline(list, item, ',');) {
+                size_t bytes;
+                if (!bench::parseSize(item, bytes)) {
+                    std::cerr << "Error: bad size '" << item << "'" << std::endl;
+                    return 1;
+                }
+                sizes.push_back(bytes);
+            }
+        } else if (arg.compare(0, 9, "--repeat=") == 0) {
+            repeat = std::max(1, std::atoi(arg.c_str() + 9));
+        } else if (!bench::parseCorpusFlag(arg, options)) {
+            std::cerr << "Usage: bench_suite [--sizes=LIST] [--repeat=N] [--seed=N] [--depth=N] "
+                         "[--statements=N] [--identifiers=P] [--strings=P] [--comments=P]" << std::endl;
+            return 1;
+        }
+    }
+
+    for (size_t size : sizes) {
+        std::string corpus;
+        bench::CorpusGenerator(options).appendUntil(corpus, size);
+
+        bench::Result r{"parser", "lexer.tokenize"};
+        r.bytes = corpus.size();
+        r.seed = options.seed;
+
+        // The interner is process-wide: the first run of each size inserts
+        // the names, later ones only look them up
+        Lexer lexer;
+        std::vector<Token> tokens;
+        bench::measure(r, repeat, [&] { std::vector<Token>().swap(tokens); },
+                       [&] { lexer.tokenize(corpus, tokens); });
+        r.tokens = tokens.size();
+        bench::report(r);
+
+        Parser parser;
+        ParseResult<FlatAst> flat;
+        r.bench = "parser.parse_flat";
+        bench::measure(r, repeat, [&] { flat = ParseResult<FlatAst>(); },
+                       [&] { flat = parser.parseFlat(tokens); });
+        if (!flat.ok()) {
+            std::cerr << "Error: the generated corpus does not parse" << std::endl;
+            return 1;
+        }
+        r.nodes = flat.ast.size();
+        bench::report(r);
+
+        ParseResult<Program> tree;
+        r.bench = "parser.parse";
+        bench::measure(r, repeat, [&] { tree = ParseResult<Program>(); },
+                       [&] { tree = parser.parse(tokens); });
+        bench::report(r);
+
+        r.bench = "ast.print";
+        OutputBuffer out;
+        bench::measure(r, repeat, [&] { out.take(); }, [&] {
+            AstWriter writer(out);
+            printProgram(tree.ast, writer);
+        });
+        bench::report(r);
+
+        r.bench = "ast.print_flat";
+        bench::measure(r, repeat, [&] { out.take(); }, [&] {
+            AstWriter writer(out);
+            printFlatAst(flat.ast, writer);
+        });
+        bench::report(r);
+    }
+    return 0;
+}
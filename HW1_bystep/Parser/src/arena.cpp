@@ -0,0 +1,60 @@
+#include "arena.h"
+
+#include <new>
+
+Arena::Arena(size_t firstChunkSize) : nextChunkSize_(firstChunkSize) {}
+
+Arena::~Arena() {
+    release();
+}
+
+Arena::Arena(Arena&& other) noexcept : nextChunkSize_(other.nextChunkSize_) {
+    *this = std::move(other);
+}
+
+Arena& Arena::operator=(Arena&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    chunks_ = other.chunks_;
+    pos_ = other.pos_;
+    end_ = other.end_;
+    nextChunkSize_ = other.nextChunkSize_;
+    chunkCount_ = other.chunkCount_;
+    bytesReserved_ = other.bytesReserved_;
+    other.chunks_ = nullptr;
+    other.pos_ = other.end_ = nullptr;
+    other.chunkCount_ = 0;
+    other.bytesReserved_ = 0;
+    return *this;
+}
+
+void Arena::release() {
+    while (chunks_) {
+        Chunk* next = chunks_->next;
+        ::operator delete(chunks_);
+        chunks_ = next;
+    }
+    pos_ = end_ = nullptr;
+    chunkCount_ = 0;
+    bytesReserved_ = 0;
+}
+
+void* Arena::allocateSlow(size_t size, size_t align) {
+    // Chunks double up to 1 MiB; oversized requests get a chunk of their own
+    size_t need = sizeof(Chunk) + size + align;
+    size_t chunkSize = nextChunkSize_ > need ? nextChunkSize_ : need;
+    if (nextChunkSize_ < 1024 * 1024) {
+        nextChunkSize_ *= 2;
+    }
+
+    // Through operator new, so that heap profiling sees the arenas
+    Chunk* chunk = static_cast<Chunk*>(::operator new(chunkSize));
+    chunk->next = chunks_;
+    chunks_ = chunk;
+    chunkCount_++;
+    bytesReserved_ += chunkSize;
+
+    pos_ = reinterpret_cast<char*>(chunk + 1);
+    end_ = reinterpret_cast<char*>(chunk) + chunkSize;
+    return allocate(size, align);
+}
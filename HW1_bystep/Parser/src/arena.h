@@ -0,0 +1,68 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Bump allocator that owns every AST node of one parse. Allocation is a
+// pointer increment inside the current chunk; nothing is freed individually,
+// and destroying the arena releases all chunks at once. Objects placed in it
+// must therefore be trivially destructible.
+class Arena {
+public:
+    explicit Arena(size_t firstChunkSize = 64 * 1024);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+    Arena(Arena&& other) noexcept;
+    Arena& operator=(Arena&& other) noexcept;
+
+    void* allocate(size_t size, size_t align) {
+        uintptr_t p = (reinterpret_cast<uintptr_t>(pos_) + (align - 1)) & ~(uintptr_t)(align - 1);
+        if (p + size > reinterpret_cast<uintptr_t>(end_)) {
+            return allocateSlow(size, align);
+        }
+        pos_ = reinterpret_cast<char*>(p + size);
+        return reinterpret_cast<void*>(p);
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "arena objects are never destroyed");
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    template <typename T>
+    T* makeArray(size_t count) {
+        static_assert(std::is_trivially_destructible<T>::value,
+                      "arena objects are never destroyed");
+        return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+    }
+
+    size_t chunkCount() const { return chunkCount_; }
+    size_t bytesReserved() const { return bytesReserved_; }
+    // Reserved bytes minus the free tail of the current chunk
+    size_t bytesUsed() const { return bytesReserved_ - static_cast<size_t>(end_ - pos_); }
+
+private:
+    struct Chunk {
+        Chunk* next;
+    };
+
+    Chunk* chunks_ = nullptr;
+    char* pos_ = nullptr;
+    char* end_ = nullptr;
+    size_t nextChunkSize_;
+    size_t chunkCount_ = 0;
+    size_t bytesReserved_ = 0;
+
+    void* allocateSlow(size_t size, size_t align);
+    void release();
+};
+
+#endif
@@ -2,178 +2,378 @@
 #define AST_H
 
 #include <string>
+#include <string_view>
 #include <vector>
-#include <memory>
+#include "arena.h"
+#include "interner.h"
+#include "lexer.h"
+#include "output.h"
 
-// Base class for all AST nodes
+// Binary operators, in the same order as the operator tokens PLUS..GTE
+enum class BinaryOp : uint8_t {
+    Add, Sub, Mul, Div, Assign, Eq, NotEq, Less, Greater, LessEq, GreaterEq
+};
+
+inline BinaryOp binaryOpFor(TokenType type) {
+    return static_cast<BinaryOp>(static_cast<uint8_t>(type) - static_cast<uint8_t>(TokenType::PLUS));
+}
+
+inline const char* binaryOpSpelling(BinaryOp op) {
+    return tokenSpelling(static_cast<TokenType>(static_cast<uint8_t>(TokenType::PLUS) + static_cast<uint8_t>(op)));
+}
+
+// Streams the indented tree format into an OutputBuffer. Newlines are held
+// back until the next line starts, so a node can drop the one that ends its
+// last child without anything being rewritten.
+class AstWriter {
+public:
+    explicit AstWriter(OutputBuffer& out) : out_(out) {}
+    ~AstWriter() { finish(); }
+
+    // Starts text at `indent` levels and returns the sink to write it to
+    OutputBuffer& line(int indent) {
+        finish();
+        out_.fill(' ', static_cast<size_t>(indent) * 2);
+        return out_;
+    }
+    void newline() { pendingNewlines_++; }
+    // Drops the last held-back newline, if there is one
+    void dropNewline() {
+        if (pendingNewlines_ > 0) pendingNewlines_--;
+    }
+    // Writes the held-back newlines
+    void finish() {
+        out_.fill('\n', pendingNewlines_);
+        pendingNewlines_ = 0;
+    }
+
+private:
+    OutputBuffer& out_;
+    size_t pendingNewlines_ = 0;
+};
+
+// What an AST node is, in the tree and in the flat representations
+enum class NodeKind : uint8_t {
+    Number,
+    Identifier,
+    String,
+    Binary,
+    Let,
+    Function,
+    If,
+    While,
+    Return
+};
+
+class AstPrinter;
+
+// Base class for all AST nodes. Nodes are allocated in the Program's Arena
+// and are never destroyed one by one, so they must stay trivially
+// destructible (no virtual destructor, no owning members).
 struct ASTNode {
-    virtual ~ASTNode() = default;
-    virtual std::string toString(int indent = 0) const = 0;
+    virtual NodeKind kind() const = 0;
+
+    // Writes the first line of the node and schedules the rest of its
+    // output, children included, on `out`. Steps are pushed in reverse so
+    // that they run in output order.
+    virtual void print(AstPrinter& out, int indent) const = 0;
+
+    // The printed text as a string, for tests and debugging
+    std::string toString(int indent = 0) const;
+};
+
+// Read-only list of child statements. Up to kInline children are stored in
+// the list itself; longer lists point at an exactly sized array in the arena.
+class NodeList {
+public:
+    static constexpr uint32_t kInline = 2;
+
+    NodeList() : size_(0), heap_(nullptr) {}
+
+    // Copies `count` pointers from `items`, using `arena` only when they do
+    // not fit inline.
+    NodeList(ASTNode* const* items, size_t count, Arena& arena) : size_(static_cast<uint32_t>(count)) {
+        ASTNode** dest = inline_;
+        if (count > kInline) {
+            dest = heap_ = arena.makeArray<ASTNode*>(count);
+        }
+        for (size_t i = 0; i < count; ++i) dest[i] = items[i];
+    }
+
+    ASTNode* const* begin() const { return size_ <= kInline ? inline_ : heap_; }
+    ASTNode* const* end() const { return begin() + size_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    ASTNode* operator[](size_t i) const { return begin()[i]; }
+
+    // Replaces entry `i` in place. Only for a list no node shares, such as
+    // Program::items.
+    void set(size_t i, ASTNode* node) { (size_ <= kInline ? inline_ : heap_)[i] = node; }
+
+private:
+    uint32_t size_;
+    union {
+        ASTNode* inline_[kInline];
+        ASTNode** heap_;
+    };
+};
+
+// Result of a parse: the top-level statements and the arena that owns them.
+struct Program {
+    Arena arena;
+    NodeList items;
+
+    ASTNode* const* begin() const { return items.begin(); }
+    ASTNode* const* end() const { return items.end(); }
+    size_t size() const { return items.size(); }
 };
 
-// Helper to create indentation
-inline std::string indentStr(int level) {
-    return std::string(level * 2, ' ');
+// Prints trees without recursion. Nodes expand into their own text plus
+// steps for their children, which wait on a heap stack, so neither deep
+// nesting nor long operator chains grow the native stack.
+class AstPrinter {
+public:
+    explicit AstPrinter(AstWriter& out) : out_(out) {}
+
+    // Prints `node` and everything scheduled under it
+    void run(const ASTNode* node, int indent) {
+        this->node(node, indent);
+        while (!stack_.empty()) {
+            Step step = stack_.back();
+            stack_.pop_back();
+            switch (step.op) {
+                case Step::LineNode:
+                    out_.newline();
+                    [[fallthrough]];
+                case Step::Node:
+                    step.node->print(*this, step.indent);
+                    break;
+                case Step::Label:
+                    out_.line(step.indent) << step.label;
+                    out_.newline();
+                    break;
+                case Step::Newline:
+                    out_.newline();
+                    break;
+                case Step::PopNewline:
+                    out_.dropNewline();
+                    break;
+            }
+        }
+    }
+
+    // Starts text at `indent` levels, as AstWriter::line() does
+    OutputBuffer& line(int indent) { return out_.line(indent); }
+    // Ends that text right away
+    void endLine() { out_.newline(); }
+
+    // Output steps, for ASTNode::print(). A node can be put on a new line
+    // first, which saves a separate step between siblings.
+    void node(const ASTNode* node, int indent, bool newlineFirst = false) {
+        Step step{newlineFirst ? Step::LineNode : Step::Node, indent, {}};
+        step.node = node;
+        stack_.push_back(step);
+    }
+    void label(int indent, const char* text) {
+        Step step{Step::Label, indent, {}};
+        step.label = text;
+        stack_.push_back(step);
+    }
+    void newline() { stack_.push_back({Step::Newline, 0, {}}); }
+    void dropNewline() { stack_.push_back({Step::PopNewline, 0, {}}); }
+
+    // Pushes "stmt \n" for every statement of `list`, last one first
+    void list(const NodeList& list, int indent) {
+        if (list.empty()) return;
+        newline();
+        for (auto it = list.end() - 1; it != list.begin(); --it) node(*it, indent, true);
+        node(*list.begin(), indent);
+    }
+
+private:
+    struct Step {
+        enum Op : uint8_t { Node, LineNode, Label, Newline, PopNewline };
+
+        Op op;
+        int indent;
+        union {
+            const ASTNode* node;
+            const char* label;
+        };
+    };
+
+    AstWriter& out_;
+    std::vector<Step> stack_;
+};
+
+inline std::string ASTNode::toString(int indent) const {
+    OutputBuffer buffer;
+    {
+        AstWriter writer(buffer);
+        AstPrinter(writer).run(this, indent);
+    }
+    return buffer.take();
+}
+
+// Prints every top-level node followed by a newline, as rustparser does
+inline void printProgram(const Program& program, AstWriter& out) {
+    AstPrinter printer(out);
+    for (const ASTNode* node : program) {
+        printer.run(node, 0);
+        out.newline();
+    }
+    out.finish();
 }
 
-// A number like 42
+// A number like 42; `value` views the source
 struct NumberLiteral : ASTNode {
-    std::string value;
+    std::string_view value;
 
-    NumberLiteral(const std::string& val) : value(val) {}
+    NumberLiteral(std::string_view val) : value(val) {}
 
-    std::string toString(int indent = 0) const override {
-        return indentStr(indent) + "NumberLiteral(" + value + ")";
+    NodeKind kind() const override { return NodeKind::Number; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "NumberLiteral(" << value << ")";
     }
 };
 
 // An identifier like x, foo, counter
 struct Identifier : ASTNode {
-    std::string name;
+    Symbol name;
 
-    Identifier(const std::string& name) : name(name) {}
+    Identifier(Symbol name) : name(name) {}
 
-    std::string toString(int indent = 0) const override {
-        return indentStr(indent) + "Identifier(" + name + ")";
+    NodeKind kind() const override { return NodeKind::Identifier; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "Identifier(" << name.str() << ")";
     }
 };
 
-// A string literal like "hello"
+// A string literal like "hello"; `value` views the source, quotes excluded
 struct StringLiteral : ASTNode {
-    std::string value;
+    std::string_view value;
 
-    StringLiteral(const std::string& val) : value(val) {}
+    StringLiteral(std::string_view val) : value(val) {}
 
-    std::string toString(int indent = 0) const override {
-        return indentStr(indent) + "StringLiteral(\"" + value + "\")";
+    NodeKind kind() const override { return NodeKind::String; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "StringLiteral(\"" << value << "\")";
     }
 };
 
 // A binary expression like 1 + 2
 struct BinaryExpr : ASTNode {
-    std::string op;
-    std::unique_ptr<ASTNode> left;
-    std::unique_ptr<ASTNode> right;
+    BinaryOp op;
+    ASTNode* left;
+    ASTNode* right;
 
-    BinaryExpr(const std::string& op,
-               std::unique_ptr<ASTNode> left,
-               std::unique_ptr<ASTNode> right)
-        : op(op), left(std::move(left)), right(std::move(right)) {}
+    BinaryExpr(BinaryOp op, ASTNode* left, ASTNode* right)
+        : op(op), left(left), right(right) {}
 
-    std::string toString(int indent = 0) const override {
-        std::string result = indentStr(indent) + "BinaryExpr(" + op + ")\n";
-        result += left->toString(indent + 1) + "\n";
-        result += right->toString(indent + 1);
-        return result;
+    NodeKind kind() const override { return NodeKind::Binary; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "BinaryExpr(" << binaryOpSpelling(op) << ")";
+        out.endLine();
+        out.node(right, indent + 1, true);
+        out.node(left, indent + 1);
     }
 };
 
 // A let declaration like: let x = 5;
 struct LetDecl : ASTNode {
-    std::string name;
+    Symbol name;
     bool isMut;
-    std::unique_ptr<ASTNode> value;
+    ASTNode* value;
 
-    LetDecl(const std::string& name, bool isMut, std::unique_ptr<ASTNode> value)
-        : name(name), isMut(isMut), value(std::move(value)) {}
+    LetDecl(Symbol name, bool isMut, ASTNode* value)
+        : name(name), isMut(isMut), value(value) {}
 
-    std::string toString(int indent = 0) const override {
-        std::string mutStr = isMut ? "mut " : "";
-        std::string result = indentStr(indent) + "LetDecl(" + mutStr + name + ")\n";
-        result += value->toString(indent + 1);
-        return result;
+    NodeKind kind() const override { return NodeKind::Let; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "LetDecl(" << (isMut ? "mut " : "") << name.str() << ")";
+        out.endLine();
+        out.node(value, indent + 1);
     }
 };
 
 // A function declaration like: fn main() { ... }
 struct FunctionDecl : ASTNode {
-    std::string name;
-    std::vector<std::unique_ptr<ASTNode>> body;
+    Symbol name;
+    NodeList body;
 
-    FunctionDecl(const std::string& name, std::vector<std::unique_ptr<ASTNode>> body)
-        : name(name), body(std::move(body)) {}
+    FunctionDecl(Symbol name, NodeList body)
+        : name(name), body(body) {}
 
-    std::string toString(int indent = 0) const override {
-        std::string result = indentStr(indent) + "FunctionDecl(" + name + ")\n";
-        for (const auto& stmt : body) {
-            result += stmt->toString(indent + 1) + "\n";
-        }
+    NodeKind kind() const override { return NodeKind::Function; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "FunctionDecl(" << name.str() << ")";
+        out.endLine();
         if (!body.empty()) {
-            result.pop_back(); // remove trailing newline
+            out.dropNewline(); // remove trailing newline
         }
-        return result;
+        out.list(body, indent + 1);
     }
 };
 
 // An if/else statement like: if x > 5 { ... } else { ... }
 struct IfStatement : ASTNode {
-    std::unique_ptr<ASTNode> condition;
-    std::vector<std::unique_ptr<ASTNode>> thenBody;
-    std::vector<std::unique_ptr<ASTNode>> elseBody; // empty if no else
-
-    IfStatement(std::unique_ptr<ASTNode> condition,
-                std::vector<std::unique_ptr<ASTNode>> thenBody,
-                std::vector<std::unique_ptr<ASTNode>> elseBody)
-        : condition(std::move(condition)),
-          thenBody(std::move(thenBody)),
-          elseBody(std::move(elseBody)) {}
-
-    std::string toString(int indent = 0) const override {
-        std::string result = indentStr(indent) + "IfStatement\n";
-        result += indentStr(indent + 1) + "Condition:\n";
-        result += condition->toString(indent + 2) + "\n";
-        result += indentStr(indent + 1) + "Then:\n";
-        for (const auto& stmt : thenBody) {
-            result += stmt->toString(indent + 2) + "\n";
-        }
+    ASTNode* condition;
+    NodeList thenBody;
+    NodeList elseBody; // empty if no else
+
+    IfStatement(ASTNode* condition, NodeList thenBody, NodeList elseBody)
+        : condition(condition), thenBody(thenBody), elseBody(elseBody) {}
+
+    NodeKind kind() const override { return NodeKind::If; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "IfStatement";
+        out.endLine();
+        out.dropNewline();
         if (!elseBody.empty()) {
-            result += indentStr(indent + 1) + "Else:\n";
-            for (const auto& stmt : elseBody) {
-                result += stmt->toString(indent + 2) + "\n";
-            }
+            out.list(elseBody, indent + 2);
+            out.label(indent + 1, "Else:");
         }
-        if (!result.empty() && result.back() == '\n') {
-            result.pop_back();
-        }
-        return result;
+        out.list(thenBody, indent + 2);
+        out.label(indent + 1, "Then:");
+        out.newline();
+        out.node(condition, indent + 2);
+        out.label(indent + 1, "Condition:");
     }
 };
 
 // A while loop like: while x > 0 { ... }
 struct WhileStatement : ASTNode {
-    std::unique_ptr<ASTNode> condition;
-    std::vector<std::unique_ptr<ASTNode>> body;
-
-    WhileStatement(std::unique_ptr<ASTNode> condition,
-                   std::vector<std::unique_ptr<ASTNode>> body)
-        : condition(std::move(condition)), body(std::move(body)) {}
-
-    std::string toString(int indent = 0) const override {
-        std::string result = indentStr(indent) + "WhileStatement\n";
-        result += indentStr(indent + 1) + "Condition:\n";
-        result += condition->toString(indent + 2) + "\n";
-        result += indentStr(indent + 1) + "Body:\n";
-        for (const auto& stmt : body) {
-            result += stmt->toString(indent + 2) + "\n";
-        }
-        if (!result.empty() && result.back() == '\n') {
-            result.pop_back();
-        }
-        return result;
+    ASTNode* condition;
+    NodeList body;
+
+    WhileStatement(ASTNode* condition, NodeList body)
+        : condition(condition), body(body) {}
+
+    NodeKind kind() const override { return NodeKind::While; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "WhileStatement";
+        out.endLine();
+        out.dropNewline();
+        out.list(body, indent + 2);
+        out.label(indent + 1, "Body:");
+        out.newline();
+        out.node(condition, indent + 2);
+        out.label(indent + 1, "Condition:");
     }
 };
 
 // A return statement like: return x + 1;
 struct ReturnStatement : ASTNode {
-    std::unique_ptr<ASTNode> value;
+    ASTNode* value;
 
-    ReturnStatement(std::unique_ptr<ASTNode> value)
-        : value(std::move(value)) {}
+    ReturnStatement(ASTNode* value)
+        : value(value) {}
 
-    std::string toString(int indent = 0) const override {
-        std::string result = indentStr(indent) + "ReturnStatement\n";
-        result += value->toString(indent + 1);
-        return result;
+    NodeKind kind() const override { return NodeKind::Return; }
+    void print(AstPrinter& out, int indent) const override {
+        out.line(indent) << "ReturnStatement";
+        out.endLine();
+        out.node(value, indent + 1);
     }
 };
 
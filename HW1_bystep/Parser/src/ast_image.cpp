@@ -0,0 +1,211 @@
+#include "ast_image.h"
+
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr char kMagic[4] = {'R', 'A', 'S', 'T'};
+
+// Byte offsets of the sections; they follow from the counts alone
+struct Layout {
+    size_t kinds, flags, payload, aux, lists, symbols, strings, end;
+};
+
+Layout layoutFor(size_t nodes, size_t lists, size_t symbols, size_t stringBytes) {
+    Layout l;
+    l.kinds = sizeof(AstImageHeader);
+    l.flags = l.kinds + nodes;
+    l.payload = (l.flags + nodes + 3) & ~size_t(3);
+    l.aux = l.payload + 4 * nodes;
+    l.lists = l.aux + 4 * nodes;
+    l.symbols = l.lists + 4 * lists;
+    l.strings = l.symbols + 4 * (symbols + 1);
+    l.end = l.strings + stringBytes;
+    return l;
+}
+
+bool hasSymbol(NodeKind kind) {
+    switch (kind) {
+        case NodeKind::Number:
+        case NodeKind::Identifier:
+        case NodeKind::String:
+        case NodeKind::Let:
+        case NodeKind::Function:
+            return true;
+        default:
+            return false;
+    }
+}
+
+bool fail(std::string* error, const char* message) {
+    if (error) *error = message;
+    return false;
+}
+
+} // namespace
+
+uint64_t imageChecksum(const char* data, size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8) {
+        uint64_t word;
+        std::memcpy(&word, data + i, 8);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    if (i < size) {
+        uint64_t word = 0;
+        std::memcpy(&word, data + i, size - i);
+        hash = (hash ^ word) * 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string writeAstImage(const FlatAst& ast) {
+    // Symbol IDs and literal indices mean nothing to another process: number
+    // the distinct strings this tree uses from 0, in order of first use
+    std::vector<uint32_t> payload(ast.payload);
+    std::unordered_map<std::string_view, uint32_t> renumber;
+    std::vector<uint32_t> symbols{0};
+    std::string strings;
+    for (size_t i = 0; i < ast.size(); ++i) {
+        if (!hasSymbol(ast.kinds[i])) continue;
+        std::string_view text = ast.text(static_cast<uint32_t>(i));
+        auto inserted = renumber.emplace(text, static_cast<uint32_t>(renumber.size()));
+        if (inserted.second) {
+            strings += text;
+            symbols.push_back(static_cast<uint32_t>(strings.size()));
+        }
+        payload[i] = inserted.first->second;
+    }
+
+    const size_t n = ast.size();
+    Layout l = layoutFor(n, ast.lists.size(), symbols.size() - 1, strings.size());
+    std::string image(l.end, '\0');
+    char* out = &image[0];
+    std::memcpy(out + l.kinds, ast.kinds.data(), n);
+    std::memcpy(out + l.flags, ast.flags.data(), n);
+    std::memcpy(out + l.payload, payload.data(), 4 * n);
+    std::memcpy(out + l.aux, ast.aux.data(), 4 * n);
+    std::memcpy(out + l.lists, ast.lists.data(), 4 * ast.lists.size());
+    std::memcpy(out + l.symbols, symbols.data(), 4 * symbols.size());
+    std::memcpy(out + l.strings, strings.data(), strings.size());
+
+    AstImageHeader header = {};
+    std::memcpy(header.magic, kMagic, 4);
+    header.version = AstImageHeader::kVersion;
+    header.headerSize = sizeof(AstImageHeader);
+    header.byteOrder = AstImageHeader::kByteOrder;
+    header.nodeCount = static_cast<uint32_t>(n);
+    header.listCount = static_cast<uint32_t>(ast.lists.size());
+    header.rootList = ast.rootList;
+    header.symbolCount = static_cast<uint32_t>(symbols.size() - 1);
+    header.stringBytes = static_cast<uint32_t>(strings.size());
+    header.fileSize = l.end;
+    header.checksum = imageChecksum(out + sizeof header, l.end - sizeof header);
+    std::memcpy(out, &header, sizeof header);
+    return image;
+}
+
+bool AstImage::open(std::string_view bytes, std::string* error) {
+    *this = AstImage();
+    if (reinterpret_cast<uintptr_t>(bytes.data()) % 8 != 0) return fail(error, "misaligned image");
+    if (bytes.size() < sizeof(AstImageHeader)) return fail(error, "truncated header");
+
+    AstImageHeader h;
+    std::memcpy(&h, bytes.data(), sizeof h);
+    if (std::memcmp(h.magic, kMagic, 4) != 0) return fail(error, "not an AST image");
+    if (h.version != AstImageHeader::kVersion) return fail(error, "unsupported version");
+    if (h.headerSize != sizeof(AstImageHeader)) return fail(error, "unsupported header size");
+    if (h.byteOrder != AstImageHeader::kByteOrder) return fail(error, "foreign byte order");
+    for (uint8_t b : h.reserved) {
+        if (b != 0) return fail(error, "corrupt header");
+    }
+    if (bytes.size() < h.fileSize) return fail(error, "truncated image");
+    if (bytes.size() != h.fileSize) return fail(error, "size mismatch");
+    Layout l = layoutFor(h.nodeCount, h.listCount, h.symbolCount, h.stringBytes);
+    if (l.end != h.fileSize) return fail(error, "corrupt header");
+    if (imageChecksum(bytes.data() + sizeof h, bytes.size() - sizeof h) != h.checksum) {
+        return fail(error, "checksum mismatch");
+    }
+
+    const char* base = bytes.data();
+    const uint8_t* kinds = reinterpret_cast<const uint8_t*>(base + l.kinds);
+    const uint8_t* flags = reinterpret_cast<const uint8_t*>(base + l.flags);
+    const uint32_t* payload = reinterpret_cast<const uint32_t*>(base + l.payload);
+    const uint32_t* aux = reinterpret_cast<const uint32_t*>(base + l.aux);
+    const uint32_t* lists = reinterpret_cast<const uint32_t*>(base + l.lists);
+    const uint32_t* symbols = reinterpret_cast<const uint32_t*>(base + l.symbols);
+
+    // The checksum only catches accidents; the structure is checked too so
+    // that the accessors stay in bounds
+    if (symbols[0] != 0 || symbols[h.symbolCount] != h.stringBytes) return fail(error, "corrupt string table");
+    for (uint32_t s = 0; s < h.symbolCount; ++s) {
+        if (symbols[s] > symbols[s + 1]) return fail(error, "corrupt string table");
+    }
+
+    // Every child must come before its parent, which rules out cycles, and
+    // have no other parent, which keeps a walk linear in the image size
+    std::vector<bool> claimed(h.nodeCount);
+    auto claim = [&](uint32_t child, uint32_t parent) {
+        if (child >= parent || claimed[child]) return false;
+        claimed[child] = true;
+        return true;
+    };
+    auto listOk = [&](uint64_t at, uint64_t count, uint32_t parent) {
+        if (at + count > h.listCount) return false;
+        for (uint64_t k = 0; k < count; ++k) {
+            if (!claim(lists[at + k], parent)) return false;
+        }
+        return true;
+    };
+
+    for (uint32_t i = 0; i < h.nodeCount; ++i) {
+        if (kinds[i] > static_cast<uint8_t>(NodeKind::Return)) return fail(error, "bad node kind");
+        NodeKind kind = static_cast<NodeKind>(kinds[i]);
+        if (hasSymbol(kind) && payload[i] >= h.symbolCount) return fail(error, "bad symbol");
+        bool ok = true;
+        switch (kind) {
+            case NodeKind::Number:
+            case NodeKind::Identifier:
+            case NodeKind::String:
+                break;
+            case NodeKind::Binary:
+                ok = i > 0 && payload[i] < i - 1 && flags[i] <= static_cast<uint8_t>(BinaryOp::GreaterEq) &&
+                     claim(payload[i], i) && claim(i - 1, i);
+                break;
+            case NodeKind::Let:
+            case NodeKind::Return:
+                ok = i > 0 && claim(i - 1, i);
+                break;
+            case NodeKind::Function:
+                ok = aux[i] < h.listCount && listOk(uint64_t(aux[i]) + 1, lists[aux[i]], i);
+                break;
+            case NodeKind::While:
+                ok = claim(payload[i], i) && aux[i] < h.listCount && listOk(uint64_t(aux[i]) + 1, lists[aux[i]], i);
+                break;
+            case NodeKind::If:
+                ok = claim(payload[i], i) && uint64_t(aux[i]) + 2 <= h.listCount &&
+                     listOk(uint64_t(aux[i]) + 2, uint64_t(lists[aux[i]]) + lists[aux[i] + 1], i);
+                break;
+        }
+        if (!ok) return fail(error, "corrupt node");
+    }
+    if (h.listCount > 0 &&
+        (h.rootList >= h.listCount || !listOk(uint64_t(h.rootList) + 1, lists[h.rootList], h.nodeCount))) {
+        return fail(error, "corrupt root list");
+    }
+
+    nodeCount_ = h.nodeCount;
+    listCount_ = h.listCount;
+    rootList_ = h.rootList;
+    kinds_ = kinds;
+    flags_ = flags;
+    payload_ = payload;
+    aux_ = aux;
+    lists_ = lists;
+    symbols_ = symbols;
+    strings_ = base + l.strings;
+    return true;
+}
@@ -0,0 +1,106 @@
+#ifndef AST_IMAGE_H
+#define AST_IMAGE_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include "flat_ast.h"
+
+// Position-independent file image of a FlatAst. Children are node indices
+// and names are offsets into a string table, so a later stage can map the
+// file and walk the tree in place: AstImage only points into the bytes, and
+// nothing past the validation in open() allocates.
+//
+//   header    64 bytes, see AstImageHeader
+//   kinds     u8  per node
+//   flags     u8  per node, then zero padding to a multiple of 4
+//   payload   u32 per node   (names and literals are string table indices)
+//   aux       u32 per node
+//   lists     u32 per entry
+//   symbols   u32 per string + 1, start offsets into `strings`
+//   strings   the names and literals, back to back
+//
+// The arrays hold the FlatAst arrays unchanged apart from the string
+// renumbering, in the byte order of the writer; the header records it and
+// a reader with the other byte order rejects the image.
+struct AstImageHeader {
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint32_t kByteOrder = 0x01020304;
+
+    char magic[4];             // "RAST"
+    uint16_t version;
+    uint16_t headerSize;       // sizeof(AstImageHeader)
+    uint32_t byteOrder;        // kByteOrder as written
+    uint32_t nodeCount;
+    uint32_t listCount;        // entries in `lists`
+    uint32_t rootList;
+    uint32_t symbolCount;
+    uint32_t stringBytes;
+    uint64_t fileSize;
+    uint64_t checksum;         // imageChecksum() of everything after the header
+    uint8_t reserved[16];      // zero
+};
+static_assert(sizeof(AstImageHeader) == 64, "the header layout is part of the format");
+
+// Serializes `ast` into image bytes
+std::string writeAstImage(const FlatAst& ast);
+
+// Checksum stored in the header: FNV-1a over 64-bit words (the tail is
+// zero-padded to a whole word)
+uint64_t imageChecksum(const char* data, size_t size);
+
+// Read-only view of an image, with the accessors of FlatAst
+class AstImage {
+public:
+    // Validates `bytes` and, when they are a complete, consistent image,
+    // views them. Besides the header and checksum every node is checked, so
+    // walking a view that opened stays in bounds and visits each node once.
+    // The bytes must be 8-byte aligned (as mapped or heap memory is) and stay
+    // unchanged while the view is in use.
+    bool open(std::string_view bytes, std::string* error = nullptr);
+
+    size_t size() const { return nodeCount_; }
+
+    NodeKind kind(uint32_t node) const { return static_cast<NodeKind>(kinds_[node]); }
+    // Name or literal text of a Number, Identifier, String, Let or Function
+    std::string_view text(uint32_t node) const {
+        uint32_t s = payload_[node];
+        return std::string_view(strings_ + symbols_[s], symbols_[s + 1] - symbols_[s]);
+    }
+    BinaryOp op(uint32_t node) const { return static_cast<BinaryOp>(flags_[node]); }
+    bool isMut(uint32_t node) const { return flags_[node] != 0; }
+    uint32_t left(uint32_t node) const { return payload_[node]; }
+    uint32_t condition(uint32_t node) const { return payload_[node]; }
+    static uint32_t operand(uint32_t node) { return node - 1; }
+
+    FlatAst::Range roots() const {
+        return listCount_ == 0 ? FlatAst::Range{nullptr, nullptr} : listAt(rootList_ + 1, lists_[rootList_]);
+    }
+    FlatAst::Range body(uint32_t node) const { return listAt(aux_[node] + 1, lists_[aux_[node]]); }
+    FlatAst::Range thenBody(uint32_t node) const { return listAt(aux_[node] + 2, lists_[aux_[node]]); }
+    FlatAst::Range elseBody(uint32_t node) const {
+        return listAt(aux_[node] + 2 + lists_[aux_[node]], lists_[aux_[node] + 1]);
+    }
+
+private:
+    uint32_t nodeCount_ = 0;
+    uint32_t listCount_ = 0;
+    uint32_t rootList_ = 0;
+    const uint8_t* kinds_ = nullptr;
+    const uint8_t* flags_ = nullptr;
+    const uint32_t* payload_ = nullptr;
+    const uint32_t* aux_ = nullptr;
+    const uint32_t* lists_ = nullptr;
+    const uint32_t* symbols_ = nullptr;
+    const char* strings_ = nullptr;
+
+    FlatAst::Range listAt(uint32_t at, uint32_t count) const {
+        const uint32_t* items = lists_ + at;
+        return FlatAst::Range{items, items + count};
+    }
+};
+
+// Writes the tree of an image in the format of printProgram()
+void printFlatAst(const AstImage& image, AstWriter& out);
+
+#endif
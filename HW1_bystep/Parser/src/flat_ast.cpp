@@ -0,0 +1,198 @@
+#include "flat_ast.h"
+#include "ast_image.h"
+
+namespace {
+
+// One unit of pending output work. The printer pops steps off a stack, and a
+// node expands into its own text plus further steps for its children.
+struct Step {
+    enum Op : uint8_t { Node, Label, Newline, PopNewline };
+
+    Op op;
+    int indent;
+    uint32_t node;
+    const char* label;
+};
+
+// Works on anything with the accessors of FlatAst
+template <class Ast>
+class FlatPrinter {
+public:
+    FlatPrinter(const Ast& ast, AstWriter& out) : ast_(ast), out_(out) {}
+
+    void run() {
+        for (auto it = ast_.roots().end(); it != ast_.roots().begin();) {
+            push(Step::Newline, 0);
+            push(Step::Node, 0, *--it);
+        }
+        while (!stack_.empty()) {
+            Step step = stack_.back();
+            stack_.pop_back();
+            switch (step.op) {
+                case Step::Node:
+                    expand(step.node, step.indent);
+                    break;
+                case Step::Label:
+                    out_.line(step.indent) << step.label;
+                    out_.newline();
+                    break;
+                case Step::Newline:
+                    out_.newline();
+                    break;
+                case Step::PopNewline:
+                    out_.dropNewline();
+                    break;
+            }
+        }
+        out_.finish();
+    }
+
+private:
+    const Ast& ast_;
+    AstWriter& out_;
+    std::vector<Step> stack_;
+
+    void push(Step::Op op, int indent, uint32_t node = 0, const char* label = nullptr) {
+        stack_.push_back({op, indent, node, label});
+    }
+
+    // Pushes "stmt \n" for every statement of `list`, last one first
+    void pushList(FlatAst::Range list, int indent) {
+        for (auto it = list.end(); it != list.begin();) {
+            push(Step::Newline, 0);
+            push(Step::Node, indent, *--it);
+        }
+    }
+
+    // Writes `head name tail` as a line, optionally ending it
+    void line(int indent, const char* head, std::string_view name, const char* tail, bool end) {
+        out_.line(indent) << head << name << tail;
+        if (end) out_.newline();
+    }
+
+    // Writes the first line of `node` and schedules the rest. Steps are
+    // pushed in reverse so that they run in output order.
+    void expand(uint32_t node, int indent) {
+        switch (ast_.kind(node)) {
+            case NodeKind::Number:
+                line(indent, "NumberLiteral(", ast_.text(node), ")", false);
+                break;
+            case NodeKind::Identifier:
+                line(indent, "Identifier(", ast_.text(node), ")", false);
+                break;
+            case NodeKind::String:
+                line(indent, "StringLiteral(\"", ast_.text(node), "\")", false);
+                break;
+            case NodeKind::Binary:
+                line(indent, "BinaryExpr(", binaryOpSpelling(ast_.op(node)), ")", true);
+                push(Step::Node, indent + 1, Ast::operand(node));
+                push(Step::Newline, 0);
+                push(Step::Node, indent + 1, ast_.left(node));
+                break;
+            case NodeKind::Let:
+                line(indent, ast_.isMut(node) ? "LetDecl(mut " : "LetDecl(", ast_.text(node), ")", true);
+                push(Step::Node, indent + 1, Ast::operand(node));
+                break;
+            case NodeKind::Return:
+                line(indent, "ReturnStatement", "", "", true);
+                push(Step::Node, indent + 1, Ast::operand(node));
+                break;
+            case NodeKind::Function:
+                line(indent, "FunctionDecl(", ast_.text(node), ")", true);
+                if (!ast_.body(node).empty()) {
+                    push(Step::PopNewline, 0);
+                }
+                pushList(ast_.body(node), indent + 1);
+                break;
+            case NodeKind::If:
+                line(indent, "IfStatement", "", "", true);
+                push(Step::PopNewline, 0);
+                if (!ast_.elseBody(node).empty()) {
+                    pushList(ast_.elseBody(node), indent + 2);
+                    push(Step::Label, indent + 1, 0, "Else:");
+                }
+                pushList(ast_.thenBody(node), indent + 2);
+                push(Step::Label, indent + 1, 0, "Then:");
+                push(Step::Newline, 0);
+                push(Step::Node, indent + 2, ast_.condition(node));
+                push(Step::Label, indent + 1, 0, "Condition:");
+                break;
+            case NodeKind::While:
+                line(indent, "WhileStatement", "", "", true);
+                push(Step::PopNewline, 0);
+                pushList(ast_.body(node), indent + 2);
+                push(Step::Label, indent + 1, 0, "Body:");
+                push(Step::Newline, 0);
+                push(Step::Node, indent + 2, ast_.condition(node));
+                push(Step::Label, indent + 1, 0, "Condition:");
+                break;
+        }
+    }
+};
+
+} // namespace
+
+void printFlatAst(const FlatAst& ast, AstWriter& out) {
+    FlatPrinter<FlatAst>(ast, out).run();
+}
+
+void printFlatAst(const AstImage& image, AstWriter& out) {
+    FlatPrinter<AstImage>(image, out).run();
+}
+
+std::string printFlatAst(const FlatAst& ast) {
+    OutputBuffer buffer;
+    AstWriter writer(buffer);
+    printFlatAst(ast, writer);
+    return buffer.take();
+}
+
+Program toProgram(const FlatAst& ast) {
+    Program program;
+    Arena& arena = program.arena;
+    std::vector<ASTNode*> built(ast.size());
+    std::vector<ASTNode*> items;
+
+    auto list = [&](FlatAst::Range range) {
+        items.clear();
+        for (uint32_t i : range) items.push_back(built[i]);
+        return NodeList(items.data(), items.size(), arena);
+    };
+
+    // Post-order: the children of node i are always built before i
+    for (uint32_t i = 0; i < ast.size(); ++i) {
+        switch (ast.kinds[i]) {
+            case NodeKind::Number:
+                built[i] = arena.make<NumberLiteral>(ast.text(i));
+                break;
+            case NodeKind::Identifier:
+                built[i] = arena.make<Identifier>(ast.symbol(i));
+                break;
+            case NodeKind::String:
+                built[i] = arena.make<StringLiteral>(ast.text(i));
+                break;
+            case NodeKind::Binary:
+                built[i] = arena.make<BinaryExpr>(ast.op(i), built[ast.left(i)], built[FlatAst::operand(i)]);
+                break;
+            case NodeKind::Let:
+                built[i] = arena.make<LetDecl>(ast.symbol(i), ast.isMut(i), built[FlatAst::operand(i)]);
+                break;
+            case NodeKind::Return:
+                built[i] = arena.make<ReturnStatement>(built[FlatAst::operand(i)]);
+                break;
+            case NodeKind::Function:
+                built[i] = arena.make<FunctionDecl>(ast.symbol(i), list(ast.body(i)));
+                break;
+            case NodeKind::If: {
+                NodeList thenBody = list(ast.thenBody(i));
+                built[i] = arena.make<IfStatement>(built[ast.condition(i)], thenBody, list(ast.elseBody(i)));
+                break;
+            }
+            case NodeKind::While:
+                built[i] = arena.make<WhileStatement>(built[ast.condition(i)], list(ast.body(i)));
+                break;
+        }
+    }
+    program.items = list(ast.roots());
+    return program;
+}
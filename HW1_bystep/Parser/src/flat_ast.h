@@ -0,0 +1,104 @@
+#ifndef FLAT_AST_H
+#define FLAT_AST_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "ast.h"
+
+// Index-based AST stored as parallel arrays. Node i is described by
+// kinds[i], flags[i], payload[i] and aux[i]; children are referred to by
+// 32-bit node indices. Nodes are numbered in post-order, so every child
+// comes before its parent and a pass that does not care about nesting can
+// simply loop over the arrays.
+//
+//   kind                 flags      payload        children
+//   Number/String        -          literal index  -
+//   Identifier           -          symbol id      -
+//   Binary               BinaryOp   left index     right = i - 1
+//   Let                  isMut      symbol id      value = i - 1
+//   Return               -          -              value = i - 1
+//   Function             -          symbol id      body list at aux
+//   While                -          cond index     body list at aux
+//   If                   -          cond index     then/else lists at aux
+//
+// Statement lists live in `lists`: a count followed by the node indices, and
+// for If two counts (then, else) followed by both lists back to back. The
+// text of literals is in `literals`, viewing the source.
+struct FlatAst {
+    std::vector<NodeKind> kinds;
+    std::vector<uint8_t> flags;
+    std::vector<uint32_t> payload;
+    std::vector<uint32_t> aux;
+    std::vector<uint32_t> lists;
+    std::vector<std::string_view> literals;
+    uint32_t rootList = 0;    // list of the top-level statements
+
+    // View of a run of node indices inside `lists`
+    struct Range {
+        const uint32_t* first;
+        const uint32_t* last;
+
+        const uint32_t* begin() const { return first; }
+        const uint32_t* end() const { return last; }
+        size_t size() const { return static_cast<size_t>(last - first); }
+        bool empty() const { return first == last; }
+        uint32_t operator[](size_t i) const { return first[i]; }
+    };
+
+    size_t size() const { return kinds.size(); }
+
+    // Appends a node and returns its index
+    uint32_t add(NodeKind kind, uint8_t flag, uint32_t data, uint32_t list = 0) {
+        kinds.push_back(kind);
+        flags.push_back(flag);
+        payload.push_back(data);
+        aux.push_back(list);
+        return static_cast<uint32_t>(kinds.size() - 1);
+    }
+
+    // Appends the text of a literal and returns its index
+    uint32_t literal(std::string_view text) {
+        literals.push_back(text);
+        return static_cast<uint32_t>(literals.size() - 1);
+    }
+
+    NodeKind kind(uint32_t node) const { return kinds[node]; }
+    Symbol symbol(uint32_t node) const { return Symbol{payload[node]}; }
+    // Text of a literal, or the name of an Identifier, Let or Function
+    std::string_view text(uint32_t node) const {
+        NodeKind k = kinds[node];
+        return k == NodeKind::Number || k == NodeKind::String ? literals[payload[node]] : symbol(node).str();
+    }
+    BinaryOp op(uint32_t node) const { return static_cast<BinaryOp>(flags[node]); }
+    bool isMut(uint32_t node) const { return flags[node] != 0; }
+    uint32_t left(uint32_t node) const { return payload[node]; }
+    uint32_t condition(uint32_t node) const { return payload[node]; }
+    // Right operand of a Binary, value of a Let or Return
+    static uint32_t operand(uint32_t node) { return node - 1; }
+
+    Range roots() const {
+        return lists.empty() ? Range{nullptr, nullptr} : listAt(rootList + 1, lists[rootList]);
+    }
+    Range body(uint32_t node) const { return listAt(aux[node] + 1, lists[aux[node]]); }
+    Range thenBody(uint32_t node) const { return listAt(aux[node] + 2, lists[aux[node]]); }
+    Range elseBody(uint32_t node) const {
+        return listAt(aux[node] + 2 + lists[aux[node]], lists[aux[node] + 1]);
+    }
+
+private:
+    Range listAt(uint32_t at, uint32_t count) const {
+        const uint32_t* items = lists.data() + at;
+        return Range{items, items + count};
+    }
+};
+
+// Writes the whole program in the same format as printProgram(). Walks the
+// arrays with an explicit stack, so deep nesting does not recurse.
+void printFlatAst(const FlatAst& ast, AstWriter& out);
+std::string printFlatAst(const FlatAst& ast);
+
+// Builds the equivalent pointer-based tree in one forward pass.
+Program toProgram(const FlatAst& ast);
+
+#endif
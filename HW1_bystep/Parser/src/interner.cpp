@@ -0,0 +1,129 @@
+#include "interner.h"
+
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+
+namespace {
+
+// The table a Scope has made current on this thread
+thread_local Interner* installed = nullptr;
+
+} // namespace
+
+std::string_view Symbol::str() const {
+    return Interner::current().lookup(*this);
+}
+
+Interner::Interner() : shards_(new Shard[kShards]) {}
+
+Interner::~Interner() {
+    for (uint32_t s = 0; s < kShards; ++s) {
+        for (auto& segment : shards_[s].segments) {
+            delete[] segment.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+Interner& Interner::current() {
+    if (installed) return *installed;
+    static Interner table;
+    return table;
+}
+
+Interner::Scope::Scope(Interner& table) : previous_(installed) {
+    installed = &table;
+}
+
+Interner::Scope::~Scope() {
+    installed = previous_;
+}
+
+// Segment k holds kFirstSegment << k entries and starts at kFirstSegment * (2^k - 1)
+void Interner::locate(uint32_t local, uint32_t& segment, uint32_t& offset) {
+    uint32_t scaled = local / kFirstSegment + 1;
+    segment = 31 - static_cast<uint32_t>(__builtin_clz(scaled));
+    offset = local - kFirstSegment * ((1u << segment) - 1);
+}
+
+std::string_view Interner::Shard::store(std::string_view text) {
+    if (text.size() > kBlockSize / 4) {
+        large.emplace_back(new char[text.size()]);
+        std::memcpy(large.back().get(), text.data(), text.size());
+        return std::string_view(large.back().get(), text.size());
+    }
+    if (text.size() > blockLeft) {
+        blocks.emplace_back(new char[kBlockSize]);
+        blockPos = blocks.back().get();
+        blockLeft = kBlockSize;
+    }
+    if (!text.empty()) {
+        std::memcpy(blockPos, text.data(), text.size());
+    }
+    std::string_view stored(blockPos, text.size());
+    blockPos += text.size();
+    blockLeft -= text.size();
+    return stored;
+}
+
+Symbol Interner::intern(std::string_view text) {
+    size_t hash = std::hash<std::string_view>{}(text);
+    uint32_t shardIndex = static_cast<uint32_t>(hash >> 7) & (kShards - 1);
+    Shard& shard = shards_[shardIndex];
+
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    auto it = shard.index.find(text);
+    if (it != shard.index.end()) {
+        return Symbol{it->second};
+    }
+
+    // Leave room for the shard bits and keep clear of Symbol::kNone
+    if (shard.count >= (1u << (32 - kShardBits)) - 1) {
+        throw std::length_error("Interner: too many symbols");
+    }
+    uint32_t local = shard.count++;
+    uint32_t segment, offset;
+    locate(local, segment, offset);
+    std::string_view* entries = shard.segments[segment].load(std::memory_order_relaxed);
+    if (!entries) {
+        entries = new std::string_view[kFirstSegment << segment];
+        shard.segments[segment].store(entries, std::memory_order_release);
+    }
+
+    std::string_view stored = shard.store(text);
+    entries[offset] = stored;
+    uint32_t id = (local << kShardBits) | shardIndex;
+    shard.index.emplace(stored, id);
+    return Symbol{id};
+}
+
+std::string_view Interner::lookup(Symbol symbol) const {
+    if (!symbol.valid()) return {};
+    const Shard& shard = shards_[symbol.id & (kShards - 1)];
+    uint32_t segment, offset;
+    locate(symbol.id >> kShardBits, segment, offset);
+    return shard.segments[segment].load(std::memory_order_acquire)[offset];
+}
+
+void Interner::clear() {
+    // The entry segments are kept as they are: an entry is written before
+    // any symbol can refer to it
+    for (uint32_t s = 0; s < kShards; ++s) {
+        Shard& shard = shards_[s];
+        shard.index.clear();
+        shard.count = 0;
+        shard.large.clear();
+        if (shard.blocks.size() > 1) shard.blocks.resize(1);
+        shard.blockPos = shard.blocks.empty() ? nullptr : shard.blocks.front().get();
+        shard.blockLeft = shard.blocks.empty() ? 0 : kBlockSize;
+    }
+}
+
+size_t Interner::size() const {
+    size_t total = 0;
+    for (uint32_t s = 0; s < kShards; ++s) {
+        std::lock_guard<std::mutex> lock(shards_[s].mutex);
+        total += shards_[s].count;
+    }
+    return total;
+}
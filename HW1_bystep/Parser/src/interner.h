@@ -0,0 +1,100 @@
+#ifndef INTERNER_H
+#define INTERNER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Compact handle for an interned string. Two symbols are equal exactly when
+// their strings are, so names can be compared as integers.
+struct Symbol {
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+    uint32_t id = kNone;
+
+    bool valid() const { return id != kNone; }
+
+    // Text of the symbol in Interner::current(), valid until that table is
+    // cleared or destroyed.
+    std::string_view str() const;
+
+    bool operator==(Symbol other) const { return id == other.id; }
+    bool operator!=(Symbol other) const { return id != other.id; }
+};
+
+// Thread-safe string interner. Strings are spread over independently locked
+// shards by hash, so concurrent lexers only contend when they insert into
+// the same shard at the same moment; lookups by symbol take no lock at all.
+class Interner {
+public:
+    Interner();
+    ~Interner();
+
+    Interner(const Interner&) = delete;
+    Interner& operator=(const Interner&) = delete;
+
+    // Returns the symbol for `text`, inserting a copy on first sight.
+    Symbol intern(std::string_view text);
+
+    // Text of a symbol returned by this interner.
+    std::string_view lookup(Symbol symbol) const;
+
+    // Number of distinct strings interned so far.
+    size_t size() const;
+
+    // Forgets every string, keeping the memory for the next ones. Symbols
+    // and texts handed out before are invalid afterwards. Not safe while
+    // another thread uses the table.
+    void clear();
+
+    // The table the lexer interns into and symbols are looked up in on this
+    // thread: the one a Scope has installed, or else a process-wide one.
+    static Interner& current();
+
+    // Makes `table` current on this thread for the lifetime of the Scope,
+    // e.g. one table per file in batch mode.
+    class Scope {
+    public:
+        explicit Scope(Interner& table);
+        ~Scope();
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+    private:
+        Interner* previous_;
+    };
+
+private:
+    static constexpr uint32_t kShardBits = 6;
+    static constexpr uint32_t kShards = 1u << kShardBits;
+    // Entries of a shard live in segments of doubling size, so they never move
+    // and a reader can find one without locking.
+    static constexpr uint32_t kFirstSegment = 256;
+    static constexpr uint32_t kSegments = 32 - kShardBits;
+    // Strings are copied into blocks of this size; longer ones get their own.
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    struct Shard {
+        mutable std::mutex mutex;
+        std::unordered_map<std::string_view, uint32_t> index;
+        std::atomic<std::string_view*> segments[kSegments] = {};
+        uint32_t count = 0;
+        std::vector<std::unique_ptr<char[]>> blocks;   // kBlockSize each
+        std::vector<std::unique_ptr<char[]>> large;    // one long string each
+        char* blockPos = nullptr;
+        size_t blockLeft = 0;
+
+        std::string_view store(std::string_view text);
+    };
+
+    std::unique_ptr<Shard[]> shards_;
+
+    static void locate(uint32_t local, uint32_t& segment, uint32_t& offset);
+};
+
+#endif
@@ -1,108 +1,154 @@
 #include "lexer.h"
+#include "common/keywords.h"
+#include "stats.h"
 
-std::vector<Token> Lexer::tokenize(const std::string& source) {
+static_assert(static_cast<int>(TokenType::KW_FN) == static_cast<int>(Keyword::Fn) &&
+                  static_cast<int>(TokenType::KW_RETURN) == static_cast<int>(Keyword::Return),
+              "TokenType lists the keywords in the order of Keyword");
+
+// A keyword's token type, or IDENTIFIER
+static TokenType keywordType(std::string_view word) {
+    Keyword keyword = classifyKeyword(word);
+    return keyword == Keyword::None ? TokenType::IDENTIFIER : static_cast<TokenType>(keyword);
+}
+
+// Token type of a single-char operator or punctuation mark, or UNKNOWN.
+static TokenType singleCharType(char ch) {
+    switch (ch) {
+        case '+': return TokenType::PLUS;
+        case '-': return TokenType::MINUS;
+        case '*': return TokenType::STAR;
+        case '/': return TokenType::SLASH;
+        case '=': return TokenType::ASSIGN;
+        case '<': return TokenType::LT;
+        case '>': return TokenType::GT;
+        case '(': return TokenType::LPAREN;
+        case ')': return TokenType::RPAREN;
+        case '{': return TokenType::LBRACE;
+        case '}': return TokenType::RBRACE;
+        case ';': return TokenType::SEMICOLON;
+        case ':': return TokenType::COLON;
+        case ',': return TokenType::COMMA;
+        default:  return TokenType::UNKNOWN;
+    }
+}
+
+void Lexer::reset(std::string_view source) {
+    source_ = source;
+    pos_ = 0;
+}
+
+std::vector<Token> Lexer::tokenize(std::string_view source) {
     std::vector<Token> tokens;
-    int pos = 0;
-    int length = source.length();
+    tokenize(source, tokens);
+    return tokens;
+}
 
-    while (pos < length) {
-        char ch = source[pos];
+void Lexer::tokenize(std::string_view source, std::vector<Token>& tokens) {
+    reset(source);
+    tokens.clear();
+    for (;;) {
+        Token tok = nextToken();
+        if (tok.type == TokenType::END_OF_FILE) break;
+        tokens.push_back(std::move(tok));
+    }
+}
+
+Token Lexer::nextToken() {
+    Token token = scan();
+    if constexpr (kStatsEnabled) {
+        if (counts_) counts_[static_cast<size_t>(token.type)]++;
+    }
+    return token;
+}
+
+Token Lexer::scan() {
+    size_t length = source_.length();
+
+    while (pos_ < length) {
+        char ch = source_[pos_];
 
         // Skip whitespace
         if (ch == ' ' || ch == '\n' || ch == '\t' || ch == '\r') {
-            pos++;
+            pos_++;
             continue;
         }
 
         // Read a word (letters, digits, underscores)
         if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_') {
-            std::string word;
-            while (pos < length) {
-                char c = source[pos];
+            size_t start = pos_;
+            while (pos_ < length) {
+                char c = source_[pos_];
                 if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
                     (c >= '0' && c <= '9') || c == '_') {
-                    word += c;
-                    pos++;
+                    pos_++;
                 } else {
                     break;
                 }
             }
+            std::string_view word = source_.substr(start, pos_ - start);
 
             // Check if it's a keyword
-            if (word == "fn" || word == "let" || word == "mut" ||
-                word == "if" || word == "else" || word == "while" ||
-                word == "return") {
-                tokens.push_back({"KEYWORD", word});
-            } else {
-                tokens.push_back({"IDENTIFIER", word});
+            TokenType type = keywordType(word);
+            if (type != TokenType::IDENTIFIER) {
+                return {type, tokenSpelling(type), Symbol{}};
             }
-            continue;
+            return {TokenType::IDENTIFIER, word, Interner::current().intern(word)};
         }
 
         // Read a number
         if (ch >= '0' && ch <= '9') {
-            std::string number;
-            while (pos < length && source[pos] >= '0' && source[pos] <= '9') {
-                number += source[pos];
-                pos++;
+            size_t start = pos_;
+            while (pos_ < length && source_[pos_] >= '0' && source_[pos_] <= '9') {
+                pos_++;
             }
-            tokens.push_back({"NUMBER", number});
-            continue;
+            return {TokenType::NUMBER, source_.substr(start, pos_ - start), Symbol{}};
         }
 
         // Read a string
         if (ch == '"') {
-            std::string str;
-            pos++; // skip opening "
-            while (pos < length && source[pos] != '"') {
-                str += source[pos];
-                pos++;
+            pos_++; // skip opening "
+            size_t start = pos_;
+            while (pos_ < length && source_[pos_] != '"') {
+                pos_++;
             }
-            pos++; // skip closing "
-            tokens.push_back({"STRING", str});
-            continue;
+            std::string_view str = source_.substr(start, pos_ - start);
+            pos_++; // skip closing "
+            return {TokenType::STRING, str, Symbol{}};
         }
 
         // Skip comments (// until end of line)
-        if (ch == '/' && pos + 1 < length && source[pos + 1] == '/') {
-            while (pos < length && source[pos] != '\n') {
-                pos++;
+        if (ch == '/' && pos_ + 1 < length && source_[pos_ + 1] == '/') {
+            while (pos_ < length && source_[pos_] != '\n') {
+                pos_++;
             }
             continue;
         }
 
         // Two-char operators: ==, !=, <=, >=
-        if (pos + 1 < length && source[pos + 1] == '=') {
-            if (ch == '=' || ch == '!' || ch == '<' || ch == '>') {
-                std::string op;
-                op += ch;
-                op += '=';
-                tokens.push_back({"OPERATOR", op});
-                pos += 2;
-                continue;
+        if (pos_ + 1 < length && source_[pos_ + 1] == '=') {
+            TokenType type = TokenType::UNKNOWN;
+            switch (ch) {
+                case '=': type = TokenType::EQ;  break;
+                case '!': type = TokenType::NEQ; break;
+                case '<': type = TokenType::LTE; break;
+                case '>': type = TokenType::GTE; break;
+            }
+            if (type != TokenType::UNKNOWN) {
+                pos_ += 2;
+                return {type, tokenSpelling(type), Symbol{}};
             }
         }
 
-        // Single-char operators
-        if (ch == '+' || ch == '-' || ch == '*' || ch == '/' ||
-            ch == '=' || ch == '<' || ch == '>') {
-            tokens.push_back({"OPERATOR", std::string(1, ch)});
-            pos++;
-            continue;
-        }
-
-        // Punctuation
-        if (ch == '(' || ch == ')' || ch == '{' || ch == '}' ||
-            ch == ';' || ch == ':' || ch == ',') {
-            tokens.push_back({"PUNCTUATION", std::string(1, ch)});
-            pos++;
-            continue;
+        // Single-char operators and punctuation; anything else is an
+        // unknown single character
+        pos_++;
+        TokenType type = singleCharType(ch);
+        if (type == TokenType::UNKNOWN) {
+            return {type, source_.substr(pos_ - 1, 1), Symbol{}};
         }
-
-        // Anything else: unknown single character
-        tokens.push_back({"UNKNOWN", std::string(1, ch)});
-        pos++;
+        return {type, tokenSpelling(type), Symbol{}};
     }
 
-    return tokens;
+    return {TokenType::END_OF_FILE, "", Symbol{}};
 }
@@ -1,17 +1,125 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "interner.h"
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <vector>
 
+enum class TokenType : uint8_t {
+    // Keywords
+    KW_FN,
+    KW_LET,
+    KW_MUT,
+    KW_IF,
+    KW_ELSE,
+    KW_WHILE,
+    KW_RETURN,
+
+    // Literals
+    IDENTIFIER,
+    NUMBER,
+    STRING,
+
+    // Operators
+    PLUS,       // +
+    MINUS,      // -
+    STAR,       // *
+    SLASH,      // /
+    ASSIGN,     // =
+    EQ,         // ==
+    NEQ,        // !=
+    LT,         // <
+    GT,         // >
+    LTE,        // <=
+    GTE,        // >=
+
+    // Punctuation
+    LPAREN,     // (
+    RPAREN,     // )
+    LBRACE,     // {
+    RBRACE,     // }
+    SEMICOLON,  // ;
+    COLON,      // :
+    COMMA,      // ,
+
+    // Special
+    UNKNOWN,
+    END_OF_FILE
+};
+
+// Coarse category used in the token dump and in error messages,
+// e.g. "KEYWORD", "OPERATOR", "PUNCTUATION".
+inline const char* tokenCategory(TokenType type) {
+    if (type <= TokenType::KW_RETURN) return "KEYWORD";
+    if (type >= TokenType::PLUS && type <= TokenType::GTE) return "OPERATOR";
+    if (type >= TokenType::LPAREN && type <= TokenType::COMMA) return "PUNCTUATION";
+    switch (type) {
+        case TokenType::IDENTIFIER:  return "IDENTIFIER";
+        case TokenType::NUMBER:      return "NUMBER";
+        case TokenType::STRING:      return "STRING";
+        case TokenType::UNKNOWN:     return "UNKNOWN";
+        case TokenType::END_OF_FILE: return "EOF";
+        default:                     return "UNKNOWN";
+    }
+}
+
+// Source text of a keyword, operator or punctuation token ("" for the rest).
+inline const char* tokenSpelling(TokenType type) {
+    static const char* const spellings[] = {
+        "fn", "let", "mut", "if", "else", "while", "return",
+        "", "", "",
+        "+", "-", "*", "/", "=", "==", "!=", "<", ">", "<=", ">=",
+        "(", ")", "{", "}", ";", ":", ",",
+        "", "",
+    };
+    return spellings[static_cast<int>(type)];
+}
+
+inline bool isOperator(TokenType type) {
+    return type >= TokenType::PLUS && type <= TokenType::GTE;
+}
+
+// For identifiers, literals and unknown characters `value` views the
+// source, which must outlive the token and any tree built from it.
+// Identifiers also carry `symbol`, their ID in Interner::current(). For
+// keywords, operators and punctuation `value` is the static spelling.
 struct Token {
-    std::string type;   // e.g. "KEYWORD", "UNKNOWN"
-    std::string value;  // e.g. "fn"
+    TokenType type;
+    std::string_view value;  // e.g. "fn"
+    Symbol symbol;
 };
 
 class Lexer {
 public:
-    std::vector<Token> tokenize(const std::string& source);
+    Lexer() = default;
+    explicit Lexer(std::string_view source) { reset(source); }
+
+    // Start pulling tokens from a new source. The source is not copied.
+    void reset(std::string_view source);
+
+    // Returns the next token, or an END_OF_FILE token once the input is
+    // exhausted (and on every call after that).
+    Token nextToken();
+
+    // Adds one to counts[type] for every token returned from now on, for
+    // rustparser --stats; null stops counting. `counts` needs an entry for
+    // every TokenType up to END_OF_FILE.
+    void countTokens(uint64_t* counts) { counts_ = counts; }
+
+    // Convenience wrapper: all tokens of `source`, without the EOF marker.
+    std::vector<Token> tokenize(std::string_view source);
+
+    // Same, but refills `tokens` so that its capacity can be reused
+    void tokenize(std::string_view source, std::vector<Token>& tokens);
+
+private:
+    std::string_view source_;
+    size_t pos_ = 0;
+    uint64_t* counts_ = nullptr;
+
+    Token scan();
 };
 
 #endif
@@ -1,49 +1,309 @@
-#include <iostream>
 #include <fstream>
-#include <sstream>
+#include <iostream>
+#include "ast_image.h"
+#include "common/batch.h"
+#include "common/source_file.h"
 #include "lexer.h"
 #include "parser.h"
+#include "output.h"
+#include "stats.h"
+#include "common/trace.h"
 
-int main(int argc, char* argv[]) {
-    if (argc < 2) {
-        std::cout << "Usage: rustparser <file.rs>" << std::endl;
-        return 1;
+// A phase of one source, timed into `stats` and shown on the --trace timeline
+class PhaseScope {
+public:
+    PhaseScope(RunStats* stats, Phase phase) : timer_(stats, phase), span_(phaseName(phase)) {}
+
+private:
+    PhaseTimer timer_;
+    TraceSpan span_;
+};
+
+static int printErrors(const std::vector<Diagnostic>& diagnostics, OutputBuffer& out) {
+    for (const Diagnostic& d : diagnostics) {
+        out << "Parse error: " << d.message << '\n';
     }
+    return 1;
+}
 
-    // Read the file
-    std::ifstream file(argv[1]);
-    if (!file.is_open()) {
-        std::cout << "Error: cannot open file " << argv[1] << std::endl;
-        return 1;
+// Parses `input` (a token vector or a Lexer) and prints the AST section, or
+// every parse error. With an `imagePath` the flat tree is also saved there
+// as an AST image.
+template <class Input>
+static int printAst(Parser& parser, Input& input, bool flat, OutputBuffer& out, const std::string& imagePath,
+                    RunStats* stats) {
+    AstWriter writer(out);
+    if (flat || !imagePath.empty()) {
+        ParseResult<FlatAst> result;
+        {
+            PhaseScope scope(stats, Phase::Parse);
+            result = parser.parseFlat(input);
+        }
+        if (stats) {
+            stats->countNodes(result.ast);
+            stats->nested(parser.maxDepth());
+        }
+        PhaseScope scope(stats, Phase::Print);
+        if (!result.ok()) return printErrors(result.diagnostics, out);
+        out << "=== AST ===\n";
+        printFlatAst(result.ast, writer);
+        if (!imagePath.empty()) {
+            std::string image = writeAstImage(result.ast);
+            std::ofstream file(imagePath, std::ios::binary);
+            if (!file.write(image.data(), static_cast<std::streamsize>(image.size()))) {
+                writer.finish();
+                out << "Error: cannot write file " << imagePath << '\n';
+                return 1;
+            }
+        }
+    } else {
+        ParseResult<Program> result;
+        {
+            PhaseScope scope(stats, Phase::Parse);
+            result = parser.parse(input);
+        }
+        if (stats) {
+            stats->countNodes(result.ast);
+            stats->nested(parser.maxDepth());
+        }
+        PhaseScope scope(stats, Phase::Print);
+        if (!result.ok()) return printErrors(result.diagnostics, out);
+        out << "=== AST ===\n";
+        printProgram(result.ast, writer);
     }
+    return 0;
+}
+
+// Scratch state that one thread reuses from file to file
+struct Worker {
+    Interner names;
+    Lexer lexer;
+    Parser parser;
+    std::vector<Token> tokens;
+    RunStats stats;
+};
+
+// Opens `path`, timed as the read phase
+static bool openSource(SourceFile& file, const std::string& path, RunStats* stats) {
+    PhaseScope scope(stats, Phase::Read);
+    return file.open(path);
+}
 
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    std::string source = buffer.str();
+// Prints the token dump (unless streaming) and the AST of one source. With
+// `stats`, times the phases and counts into it.
+static int processSource(std::string_view source, bool stream, bool flat, Worker& w, OutputBuffer& out,
+                         const std::string& imagePath, RunStats* stats) {
+    if (stats) stats->beginFile(source.size());
+    // Each file's names go into a table of their own, cleared for the next
+    w.names.clear();
+    Interner::Scope names(w.names);
+    w.lexer.countTokens(stats ? stats->tokens : nullptr);
+    if (stream) {
+        w.lexer.reset(source);
+        return printAst(w.parser, w.lexer, flat, out, imagePath, stats);
+    }
 
     // Step 1: Tokenize
-    Lexer lexer;
-    std::vector<Token> tokens = lexer.tokenize(source);
+    {
+        PhaseScope scope(stats, Phase::Lex);
+        w.lexer.tokenize(source, w.tokens);
+    }
 
-    std::cout << "=== Tokens ===" << std::endl;
-    for (const Token& t : tokens) {
-        std::cout << "  " << t.type << ": " << t.value << std::endl;
+    {
+        PhaseScope scope(stats, Phase::Print);
+        out << "=== Tokens ===\n";
+        for (const Token& t : w.tokens) {
+            out << "  " << tokenCategory(t.type) << ": " << t.value << '\n';
+        }
+        out << '\n';
     }
-    std::cout << std::endl;
 
     // Step 2: Parse
-    Parser parser;
-    try {
-        auto ast = parser.parse(tokens);
+    return printAst(w.parser, w.tokens, flat, out, imagePath, stats);
+}
 
-        std::cout << "=== AST ===" << std::endl;
-        for (const auto& node : ast) {
-            std::cout << node->toString() << std::endl;
-        }
-    } catch (const std::runtime_error& e) {
-        std::cout << "Parse error: " << e.what() << std::endl;
+// Prints the tree of a saved AST image, walking the mapped file in place.
+// Checking the image counts as parsing it.
+static int printImage(const std::string& path, RunStats* stats) {
+    SourceFile file;
+    if (!openSource(file, path, stats)) {
+        std::cout << "Error: cannot open file " << path << std::endl;
+        return 1;
+    }
+    if (stats) stats->beginFile(file.view().size());
+    AstImage image;
+    std::string error;
+    bool valid;
+    {
+        PhaseScope scope(stats, Phase::Parse);
+        valid = image.open(file.view(), &error);
+    }
+    if (!valid) {
+        std::cout << "Error: invalid AST image " << path << ": " << error << std::endl;
         return 1;
     }
+    if (stats) stats->countNodes(image);
+    PhaseScope scope(stats, Phase::Print);
+    OutputBuffer out(std::cout);
+    out << "=== AST ===\n";
+    AstWriter writer(out);
+    printFlatAst(image, writer);
+    return 0;
+}
 
+// Batch mode: files are parsed on the pool and each one's output is printed
+// under a "==> path <==" header, in the order the paths were given.
+static int runBatch(const std::vector<std::string>& paths, unsigned jobs, bool stream, bool flat, RunStats* stats) {
+    WorkStealingPool pool(jobs);
+    std::vector<Worker> workers(pool.size());
+    OrderedWriter writer(paths.size(), std::cout, std::cerr);
+    std::vector<char> failed(paths.size(), 0);
+
+    pool.run(batchOrder(paths, pool.size()), [&](size_t index, unsigned worker) {
+        const std::string& path = paths[index];
+        TraceSpan span("file", path);
+        OutputBuffer out;
+        out << "==> " << path << " <==\n";
+        Worker& w = workers[worker];
+        RunStats* ws = stats ? &w.stats : nullptr;
+        SourceFile file;
+        if (!openSource(file, path, ws)) {
+            out << "Error: cannot open file " << path << '\n';
+            failed[index] = 1;
+        } else {
+            failed[index] = processSource(file.view(), stream, flat, w, out, std::string(), ws) != 0;
+        }
+        writer.publish(index, out.take(), std::string());
+    });
+
+    if (stats) {
+        for (const Worker& w : workers) stats->merge(w.stats);
+    }
+
+    for (char f : failed) {
+        if (f) return 1;
+    }
     return 0;
 }
+
+// One source file, or with `readAst` an AST image
+static int runSingle(const std::string& path, bool stream, bool flat, bool readAst, const std::string& writeAst,
+                     RunStats* stats) {
+    if (readAst) {
+        return printImage(path, stats);
+    }
+
+    // Map (or, for pipes and "-", read) the file
+    TraceSpan span("file", path);
+    SourceFile file;
+    if (!openSource(file, path, stats)) {
+        std::cout << "Error: cannot open file " << path << std::endl;
+        return 1;
+    }
+
+    OutputBuffer out(std::cout);
+    Worker worker;
+    return processSource(file.view(), stream, flat, worker, out, writeAst, stats);
+}
+
+int main(int argc, char* argv[]) {
+    // --stream: parse straight from the lexer without building a token vector
+    // (the token dump is skipped in this mode)
+    // --flat: build the index-based AST and print it from its arrays
+    // --jobs=N: number of worker threads in batch mode (default: all cores)
+    // --files-from=LIST: read further paths from LIST, one per line
+    // --write-ast=FILE: also save the tree as a mappable AST image
+    // --read-ast: the input is an AST image; print its tree
+    // --stats[=json]: time the read, lex, parse and print phases and count
+    //   tokens, nodes and nesting; the report goes to stderr, as a table or
+    //   as one JSON object
+    // --trace=FILE: save a timeline of the files, phases and top-level
+    //   functions of every thread as Chrome trace-event JSON
+    bool stream = false;
+    bool flat = false;
+    bool batch = false;
+    bool readAst = false;
+    std::string writeAst;
+    std::string statsFormat;
+    std::string tracePath;
+    unsigned jobs = 0;
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--stream") {
+            stream = true;
+        } else if (arg == "--flat") {
+            flat = true;
+        } else if (arg.compare(0, 12, "--write-ast=") == 0) {
+            writeAst = arg.substr(12);
+        } else if (arg == "--read-ast") {
+            readAst = true;
+        } else if (arg == "--stats" || arg == "--stats=text") {
+            statsFormat = "text";
+        } else if (arg == "--stats=json") {
+            statsFormat = "json";
+        } else if (arg.compare(0, 8, "--trace=") == 0) {
+            tracePath = arg.substr(8);
+        } else if (arg.compare(0, 7, "--jobs=") == 0) {
+            if (!parseJobs(arg.c_str() + 7, jobs)) {
+                std::cout << "Error: --jobs takes a thread count from 0 to " << kMaxJobs << ", not " << arg.substr(7)
+                          << std::endl;
+                return 1;
+            }
+        } else if (arg.compare(0, 13, "--files-from=") == 0) {
+            batch = true;
+            if (!readPathList(arg.substr(13), paths)) {
+                std::cout << "Error: cannot read file list " << arg.substr(13) << std::endl;
+                return 1;
+            }
+        } else {
+            paths.push_back(arg);
+        }
+    }
+    if (paths.empty() && !batch) {
+        std::cout << "Usage: rustparser [--stream] [--flat] [--jobs=N] [--files-from=LIST] [--write-ast=FILE] "
+                     "[--stats[=json]] [--trace=FILE] <file.rs | -> [more.rs ...]\n"
+                     "       rustparser --read-ast <file.ast>"
+                  << std::endl;
+        return 1;
+    }
+    if ((!statsFormat.empty() || !tracePath.empty()) && !kStatsEnabled) {
+        std::cout << "Error: --stats and --trace are not available in this build (PARSER_STATS=OFF)" << std::endl;
+        return 1;
+    }
+    bool many = batch || paths.size() > 1;
+    if (many && (readAst || !writeAst.empty())) {
+        std::cout << "Error: --read-ast and --write-ast take a single input" << std::endl;
+        return 1;
+    }
+
+    if (!tracePath.empty()) Tracer::start("rustparser");
+    RunStats stats;
+    RunStats* wanted = statsFormat.empty() ? nullptr : &stats;
+    int status;
+    {
+        PhaseTimer timer(wanted ? &stats.total : nullptr, true);
+        if (many) {
+            status = runBatch(paths, jobs, stream, flat, wanted);
+        } else {
+            status = runSingle(paths[0], stream, flat, readAst, writeAst, wanted);
+        }
+    }
+    if (wanted) {
+        if (statsFormat == "json") {
+            stats.writeJson(std::cerr);
+        } else {
+            stats.writeText(std::cerr);
+        }
+    }
+    if (!tracePath.empty()) {
+        // The workers are done, so their buffers can be read
+        std::ofstream file(tracePath);
+        Tracer::write(file);
+        if (!file) {
+            std::cout << "Error: cannot write file " << tracePath << std::endl;
+            return 1;
+        }
+    }
+    return status;
+}
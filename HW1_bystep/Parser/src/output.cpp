@@ -0,0 +1,29 @@
+#include "output.h"
+
+#include <utility>
+
+OutputBuffer::OutputBuffer(std::ostream& out, size_t capacity) : out_(&out), capacity_(capacity) {
+    buf_.reserve(capacity);
+}
+
+OutputBuffer::~OutputBuffer() {
+    flush();
+}
+
+void OutputBuffer::drain() {
+    if (!out_) return;
+    out_->write(buf_.data(), static_cast<std::streamsize>(buf_.size()));
+    buf_.clear();
+}
+
+void OutputBuffer::flush() {
+    if (!out_) return;
+    drain();
+    out_->flush();
+}
+
+std::string OutputBuffer::take() {
+    std::string text = std::move(buf_);
+    buf_.clear();
+    return text;
+}
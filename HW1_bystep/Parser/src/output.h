@@ -0,0 +1,57 @@
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Buffered text sink. Writes are appended to an in-memory buffer that is
+// handed to the destination stream in large blocks, so printing many short
+// lines costs one stream call per block instead of one (plus a flush) per
+// line. Without a destination stream the text simply collects in memory.
+class OutputBuffer {
+public:
+    static constexpr size_t kDefaultCapacity = 64 * 1024;
+
+    OutputBuffer() = default;
+    explicit OutputBuffer(std::ostream& out, size_t capacity = kDefaultCapacity);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    void write(std::string_view text) {
+        buf_.append(text.data(), text.size());
+        if (buf_.size() >= capacity_) drain();
+    }
+    void put(char c) {
+        buf_.push_back(c);
+        if (buf_.size() >= capacity_) drain();
+    }
+    void fill(char c, size_t count) {
+        buf_.append(count, c);
+        if (buf_.size() >= capacity_) drain();
+    }
+
+    OutputBuffer& operator<<(std::string_view text) { write(text); return *this; }
+    OutputBuffer& operator<<(const char* text) { write(text); return *this; }
+    OutputBuffer& operator<<(char c) { put(c); return *this; }
+
+    // Passes buffered text on to the stream and flushes the stream. No-op
+    // for an in-memory buffer.
+    void flush();
+
+    // Text collected so far (everything, for an in-memory buffer)
+    const std::string& str() const { return buf_; }
+    std::string take();
+
+private:
+    std::ostream* out_ = nullptr;
+    size_t capacity_ = static_cast<size_t>(-1);
+    std::string buf_;
+
+    void drain();
+};
+
+#endif
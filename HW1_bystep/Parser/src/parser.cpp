@@ -1,189 +1,879 @@
 #include "parser.h"
-#include <iostream>
+#include "common/trace.h"
+#include <algorithm>
+#include <utility>
 
 // --- Utility methods ---
 
-const Token& Parser::current() const {
-    return (*tokens_)[pos_];
+const Token& Parser::tokenAt(size_t index) {
+    if (!lexer_) {
+        return (*tokens_)[index];
+    }
+    // Pull lazily so that a token stays valid in the window until kWindow
+    // further tokens have been requested
+    while (pulled_ <= index) {
+        window_[pulled_ % kWindow] = lexer_->nextToken();
+        pulled_++;
+    }
+    return window_[index % kWindow];
 }
 
-const Token& Parser::peek() const {
-    return (*tokens_)[pos_];
+const Token& Parser::current() {
+    return tokenAt(pos_);
 }
 
-bool Parser::atEnd() const {
-    return pos_ >= (int)tokens_->size();
+const Token& Parser::peek() {
+    return tokenAt(pos_);
+}
+
+bool Parser::atEnd() {
+    if (!lexer_) {
+        return pos_ >= tokens_->size();
+    }
+    return tokenAt(pos_).type == TokenType::END_OF_FILE;
 }
 
 const Token& Parser::advance() {
-    const Token& tok = (*tokens_)[pos_];
+    const Token& tok = tokenAt(pos_);
     pos_++;
     return tok;
 }
 
-void Parser::expect(const std::string& type, const std::string& value) {
+bool Parser::expect(TokenType type) {
     if (atEnd()) {
-        throw std::runtime_error("Expected " + type + " '" + value + "' but reached end of input");
+        error(std::string("Expected ") + tokenCategory(type) + " '" + tokenSpelling(type) +
+              "' but reached end of input");
+        return false;
     }
     const Token& tok = current();
-    if (tok.type != type || tok.value != value) {
-        throw std::runtime_error("Expected " + type + " '" + value + "' but got " + tok.type + " '" + tok.value + "'");
+    if (tok.type != type) {
+        error(std::string("Expected ") + tokenCategory(type) + " '" + tokenSpelling(type) +
+              "' but got " + tokenCategory(tok.type) + " '" + std::string(tok.value) + "'");
+        return false;
     }
     advance();
+    return true;
+}
+
+// Records an error at the current token and puts the parser in panic mode.
+// Errors raised while already panicking, or at the token of the previous
+// error (e.g. several unclosed blocks at end of input), are cascades of that
+// error and are not reported again.
+void Parser::error(std::string message) {
+    if (failed_) return;
+    failed_ = true;
+    if (!diagnostics_.empty() && diagnostics_.back().token == pos_) return;
+    diagnostics_.push_back({std::move(message), pos_});
+}
+
+// Skips to the end of the broken statement: past the next `;` or past a
+// brace group opened while skipping, or up to the `}` that closes the
+// enclosing block. A stray `}` at top level is skipped too.
+void Parser::synchronize() {
+    int nesting = 0;
+    while (!atEnd()) {
+        TokenType type = current().type;
+        if (type == TokenType::SEMICOLON && nesting == 0) {
+            advance();
+            return;
+        }
+        if (type == TokenType::RBRACE) {
+            if (nesting == 0 && depth_ > 0) return;
+            advance();
+            if (nesting <= 1) return;
+            nesting--;
+            continue;
+        }
+        if (type == TokenType::LBRACE) nesting++;
+        advance();
+    }
+}
+
+// --- Builders ---
+
+namespace {
+
+// A statement whose block is being parsed. Its header has been read, and it
+// is built from the pending statements once the block closes.
+template <class Ref, class Checkpoint>
+struct OpenStatement {
+    SyntaxMap::Owner owner;       // the list being parsed
+    Checkpoint checkpoint;        // builder state before the statement
+    Ref condition;
+    Symbol name;
+    size_t mark;                  // pending stack size when the (then) body opened
+    size_t elseMark;
+    size_t block;                 // builder IDs of the body and else blocks
+    size_t elseBlock;
+};
+
+// The blocks of a tree parse as they are found, with absolute token indices
+struct BlockRecorder {
+    std::vector<SyntaxMap::Block> blocks;
+    std::vector<size_t> marks;       // pending stack size when each block opened
+    std::vector<uint32_t> open;      // blocks not closed yet
+    std::vector<size_t> itemStarts;  // first token of every top-level item
+};
+
+// Builds the pointer-based tree in the Program's arena, recording the block
+// structure too when a recorder is given
+struct TreeBuilder {
+    using Ref = ASTNode*;
+
+    Program& program;
+    std::vector<ASTNode*>& pending;
+    BlockRecorder* recorder = nullptr;
+
+    Ref number(std::string_view value) { return program.arena.make<NumberLiteral>(value); }
+    Ref identifier(Symbol name) { return program.arena.make<Identifier>(name); }
+    Ref string(std::string_view value) { return program.arena.make<StringLiteral>(value); }
+    Ref binary(BinaryOp op, Ref left, Ref right) { return program.arena.make<BinaryExpr>(op, left, right); }
+    Ref let(Symbol name, bool isMut, Ref value) { return program.arena.make<LetDecl>(name, isMut, value); }
+    Ref ret(Ref value) { return program.arena.make<ReturnStatement>(value); }
+
+    size_t mark() const { return pending.size(); }
+    void push(Ref stmt) { pending.push_back(stmt); }
+
+    // Nodes of a failed statement are simply left in the arena
+    using Checkpoint = size_t;
+    Checkpoint checkpoint() const { return pending.size(); }
+    void rollback(Checkpoint at) { pending.resize(at); }
+
+    // Statements with a block still open, innermost last
+    std::vector<OpenStatement<Ref, Checkpoint>> open{};
+
+    void item(size_t token) {
+        if (recorder) recorder->itemStarts.push_back(token);
+    }
+    size_t openBlock(size_t token) {
+        if (!recorder) return 0;
+        uint32_t id = static_cast<uint32_t>(recorder->blocks.size());
+        uint32_t parent = recorder->open.empty() ? SyntaxMap::kNone : recorder->open.back();
+        recorder->blocks.push_back({static_cast<uint32_t>(token), 0, parent, 0, SyntaxMap::Owner::Function, nullptr});
+        recorder->marks.push_back(pending.size());
+        recorder->open.push_back(id);
+        return id;
+    }
+    void closeBlock(size_t token) {
+        if (!recorder) return;
+        recorder->blocks[recorder->open.back()].close = static_cast<uint32_t>(token);
+        recorder->open.pop_back();
+    }
+    // `stmt`, which will be pushed at `mark`, holds the list of `block`
+    void own(size_t block, SyntaxMap::Owner owner, Ref stmt, size_t mark) {
+        if (!recorder) return;
+        SyntaxMap::Block& b = recorder->blocks[block];
+        b.owner = owner;
+        b.node = stmt;
+        b.slot = b.parent == SyntaxMap::kNone ? 0 : static_cast<uint32_t>(mark - recorder->marks[b.parent]);
+    }
+
+    Ref function(Symbol name, size_t bodyMark, size_t bodyBlock) {
+        NodeList body = take(bodyMark, pending.size());
+        pending.resize(bodyMark);
+        Ref node = program.arena.make<FunctionDecl>(name, body);
+        own(bodyBlock, SyntaxMap::Owner::Function, node, bodyMark);
+        return node;
+    }
+    Ref ifStatement(Ref condition, size_t thenMark, size_t elseMark, size_t thenBlock, size_t elseBlock) {
+        NodeList thenBody = take(thenMark, elseMark);
+        NodeList elseBody = take(elseMark, pending.size());
+        pending.resize(thenMark);
+        Ref node = program.arena.make<IfStatement>(condition, thenBody, elseBody);
+        own(thenBlock, SyntaxMap::Owner::Then, node, thenMark);
+        if (elseBlock != SyntaxMap::kNone) own(elseBlock, SyntaxMap::Owner::Else, node, thenMark);
+        return node;
+    }
+    Ref whileStatement(Ref condition, size_t bodyMark, size_t bodyBlock) {
+        NodeList body = take(bodyMark, pending.size());
+        pending.resize(bodyMark);
+        Ref node = program.arena.make<WhileStatement>(condition, body);
+        own(bodyBlock, SyntaxMap::Owner::While, node, bodyMark);
+        return node;
+    }
+    void finish() {
+        program.items = take(0, pending.size());
+        pending.clear();
+    }
+
+    NodeList take(size_t from, size_t to) {
+        return NodeList(pending.data() + from, to - from, program.arena);
+    }
+};
+
+// Appends nodes to a FlatAst; children are always finished before their
+// parent, which yields the post-order numbering
+struct FlatBuilder {
+    using Ref = uint32_t;
+
+    FlatAst& ast;
+    std::vector<uint32_t>& pending;
+
+    Ref number(std::string_view value) { return ast.add(NodeKind::Number, 0, ast.literal(value)); }
+    Ref identifier(Symbol name) { return ast.add(NodeKind::Identifier, 0, name.id); }
+    Ref string(std::string_view value) { return ast.add(NodeKind::String, 0, ast.literal(value)); }
+    Ref binary(BinaryOp op, Ref left, Ref) { return ast.add(NodeKind::Binary, static_cast<uint8_t>(op), left); }
+    Ref let(Symbol name, bool isMut, Ref) { return ast.add(NodeKind::Let, isMut, name.id); }
+    Ref ret(Ref) { return ast.add(NodeKind::Return, 0, 0); }
+
+    size_t mark() const { return pending.size(); }
+    void push(Ref stmt) { pending.push_back(stmt); }
+
+    // Removes the nodes of a failed statement, so that every node stays
+    // reachable and the arrays stay in post-order
+    struct Checkpoint {
+        size_t pending;
+        size_t nodes;
+        size_t lists;
+        size_t literals;
+    };
+    Checkpoint checkpoint() const { return {pending.size(), ast.size(), ast.lists.size(), ast.literals.size()}; }
+    void rollback(const Checkpoint& at) {
+        pending.resize(at.pending);
+        ast.kinds.resize(at.nodes);
+        ast.flags.resize(at.nodes);
+        ast.payload.resize(at.nodes);
+        ast.aux.resize(at.nodes);
+        ast.lists.resize(at.lists);
+        ast.literals.resize(at.literals);
+    }
+
+    // Statements with a block still open, innermost last
+    std::vector<OpenStatement<Ref, Checkpoint>> open{};
+
+    // Flat trees are not reparsed, so their blocks are not recorded
+    void item(size_t) {}
+    size_t openBlock(size_t) { return 0; }
+    void closeBlock(size_t) {}
+
+    Ref function(Symbol name, size_t bodyMark, size_t) {
+        return ast.add(NodeKind::Function, 0, name.id, take(bodyMark));
+    }
+    Ref ifStatement(Ref condition, size_t thenMark, size_t elseMark, size_t, size_t) {
+        uint32_t at = static_cast<uint32_t>(ast.lists.size());
+        ast.lists.push_back(static_cast<uint32_t>(elseMark - thenMark));
+        ast.lists.push_back(static_cast<uint32_t>(pending.size() - elseMark));
+        ast.lists.insert(ast.lists.end(), pending.begin() + thenMark, pending.end());
+        pending.resize(thenMark);
+        return ast.add(NodeKind::If, 0, condition, at);
+    }
+    Ref whileStatement(Ref condition, size_t bodyMark, size_t) {
+        return ast.add(NodeKind::While, 0, condition, take(bodyMark));
+    }
+    void finish() {
+        ast.rootList = take(0);
+    }
+
+    // Moves the statements pushed since `from` into a counted list
+    uint32_t take(size_t from) {
+        uint32_t at = static_cast<uint32_t>(ast.lists.size());
+        ast.lists.push_back(static_cast<uint32_t>(pending.size() - from));
+        ast.lists.insert(ast.lists.end(), pending.begin() + from, pending.end());
+        pending.resize(from);
+        return at;
+    }
+};
+
+// Builds a statement whose last block has closed
+template <class B, class Open>
+typename B::Ref build(B& b, const Open& stmt) {
+    switch (stmt.owner) {
+        case SyntaxMap::Owner::Function:
+            return b.function(stmt.name, stmt.mark, stmt.block);
+        case SyntaxMap::Owner::Then:
+        case SyntaxMap::Owner::Else:
+            return b.ifStatement(stmt.condition, stmt.mark, stmt.elseMark, stmt.block, stmt.elseBlock);
+        case SyntaxMap::Owner::While:
+            break;
+    }
+    return b.whileStatement(stmt.condition, stmt.mark, stmt.block);
 }
 
+} // namespace
+
 // --- Parsing ---
 
-std::vector<std::unique_ptr<ASTNode>> Parser::parse(const std::vector<Token>& tokens) {
+void Parser::start(const std::vector<Token>& tokens) {
     tokens_ = &tokens;
+    lexer_ = nullptr;
+    pos_ = 0;
+}
+
+void Parser::start(Lexer& lexer) {
+    tokens_ = nullptr;
+    lexer_ = &lexer;
+    pulled_ = 0;
     pos_ = 0;
+}
+
+// Clears the parse state and continues at token `pos`
+void Parser::reset(size_t pos) {
+    pending_.clear();
+    flatPending_.clear();
+    diagnostics_.clear();
+    failed_ = false;
+    depth_ = 0;
+    maxDepth_ = 0;
+    pos_ = pos;
+}
 
-    std::vector<std::unique_ptr<ASTNode>> program;
+ParseResult<Program> Parser::parse(const std::vector<Token>& tokens) {
+    start(tokens);
+    ParseResult<Program> result;
+    TreeBuilder builder{result.ast, pending_};
+    parseProgram(builder);
+    result.diagnostics = std::move(diagnostics_);
+    return result;
+}
+
+ParseResult<Program> Parser::parse(Lexer& lexer) {
+    start(lexer);
+    ParseResult<Program> result;
+    TreeBuilder builder{result.ast, pending_};
+    parseProgram(builder);
+    result.diagnostics = std::move(diagnostics_);
+    return result;
+}
+
+ParseResult<FlatAst> Parser::parseFlat(const std::vector<Token>& tokens) {
+    start(tokens);
+    ParseResult<FlatAst> result;
+    FlatBuilder builder{result.ast, flatPending_};
+    parseProgram(builder);
+    result.diagnostics = std::move(diagnostics_);
+    return result;
+}
+
+ParseResult<FlatAst> Parser::parseFlat(Lexer& lexer) {
+    start(lexer);
+    ParseResult<FlatAst> result;
+    FlatBuilder builder{result.ast, flatPending_};
+    parseProgram(builder);
+    result.diagnostics = std::move(diagnostics_);
+    return result;
+}
+
+template <class B>
+void Parser::parseProgram(B& b) {
+    reset(0);
     while (!atEnd()) {
-        program.push_back(parseStatement());
+        b.item(pos_);
+        if (Tracer::enabled() && current().type == TokenType::KW_FN) {
+            // A trace span for each top-level function, with its name
+            std::string_view name;
+            if (lexer_ || pos_ + 1 < tokens_->size()) {
+                const Token& next = tokenAt(pos_ + 1);
+                if (next.type == TokenType::IDENTIFIER) name = next.value;
+            }
+            TraceSpan span("fn", name);
+            parseListItem(b);
+            continue;
+        }
+        parseListItem(b);
     }
-    return program;
+    b.finish();
 }
 
-std::unique_ptr<ASTNode> Parser::parseStatement() {
-    if (!atEnd() && current().type == "KEYWORD") {
-        if (current().value == "let") return parseLetDecl();
-        if (current().value == "fn") return parseFunctionDecl();
-        if (current().value == "if") return parseIfStatement();
-        if (current().value == "while") return parseWhileStatement();
-        if (current().value == "return") return parseReturnStatement();
+// Parses one statement of a program or block onto the pending stack. If it
+// fails, whatever it built is dropped and parsing resumes after the next
+// synchronization point.
+//
+// Blocks do not recurse: a statement with a block is left on the builder's
+// open stack after its `{`, the loop carries on with the items of the
+// block, and the statement is built when its `}` is reached. The native
+// stack stays the same size however deep the nesting goes.
+template <class B>
+void Parser::parseListItem(B& b) {
+    const size_t base = b.open.size();
+    for (;;) {
+        auto checkpoint = b.checkpoint();
+        size_t opened = b.open.size();
+        auto stmt = parseStatement(b, checkpoint);
+        if (b.open.size() == opened) endListItem(b, checkpoint, stmt);
+
+        // Close the blocks that end here, innermost first
+        while (b.open.size() > base && (atEnd() || current().type == TokenType::RBRACE)) {
+            auto& top = b.open.back();
+            leaveBlock(b);
+            if (top.owner == SyntaxMap::Owner::Then) {
+                top.elseMark = b.mark();
+                if (!failed_ && !atEnd() && current().type == TokenType::KW_ELSE) {
+                    advance();
+                    top.owner = SyntaxMap::Owner::Else;
+                    if (enterBlock(b, top.elseBlock)) continue;
+                }
+            }
+            auto done = top;
+            b.open.pop_back();
+            endListItem(b, done.checkpoint, failed_ ? typename B::Ref{} : build(b, done));
+        }
+        if (b.open.size() == base) return;
     }
-    return parseExpression();
+}
+
+// Pushes a finished statement, or drops a failed one and resynchronizes
+template <class B>
+void Parser::endListItem(B& b, const typename B::Checkpoint& checkpoint, typename B::Ref stmt) {
+    if (failed_) {
+        b.rollback(checkpoint);
+        synchronize();
+        failed_ = false;
+        return;
+    }
+    b.push(stmt);
+}
+
+// Statements with a block only read their header here and open the block
+// (see parseListItem())
+template <class B>
+typename B::Ref Parser::parseStatement(B& b, const typename B::Checkpoint& checkpoint) {
+    if (!atEnd()) {
+        switch (current().type) {
+            case TokenType::KW_LET:    return parseLetDecl(b);
+            case TokenType::KW_FN:     parseFunctionDecl(b, checkpoint); return {};
+            case TokenType::KW_IF:     parseIfStatement(b, checkpoint); return {};
+            case TokenType::KW_WHILE:  parseWhileStatement(b, checkpoint); return {};
+            case TokenType::KW_RETURN: return parseReturnStatement(b);
+            default:                   break;
+        }
+    }
+    return parseExpression(b);
+}
+
+// Parse: {
+// Sets `block` to the builder's ID for the block
+template <class B>
+bool Parser::enterBlock(B& b, size_t& block) {
+    size_t open = pos_;
+    if (!expect(TokenType::LBRACE)) return false;
+    block = b.openBlock(open);
+    if (++depth_ > maxDepth_) maxDepth_ = depth_;
+    return true;
+}
+
+// Parse: }
+template <class B>
+void Parser::leaveBlock(B& b) {
+    depth_--;
+    b.closeBlock(pos_);
+    expect(TokenType::RBRACE);
 }
 
 // Parse: { stmt1; stmt2; ... }
-std::vector<std::unique_ptr<ASTNode>> Parser::parseBlock() {
-    expect("PUNCTUATION", "{");
-    std::vector<std::unique_ptr<ASTNode>> body;
-    while (!atEnd() && !(current().type == "PUNCTUATION" && current().value == "}")) {
-        body.push_back(parseStatement());
+// The statements are left on the builder's pending stack for the caller.
+// Returns the builder's ID for the block.
+template <class B>
+size_t Parser::parseBlock(B& b) {
+    size_t block = 0;
+    if (!enterBlock(b, block)) return 0;
+    while (!atEnd() && current().type != TokenType::RBRACE) {
+        parseListItem(b);
     }
-    expect("PUNCTUATION", "}");
-    return body;
+    leaveBlock(b);
+    return block;
 }
 
-// Parse: fn name() { body }
-std::unique_ptr<ASTNode> Parser::parseFunctionDecl() {
-    expect("KEYWORD", "fn");
+// Parse: fn name() {
+template <class B>
+void Parser::parseFunctionDecl(B& b, const typename B::Checkpoint& checkpoint) {
+    expect(TokenType::KW_FN);
 
-    if (atEnd() || current().type != "IDENTIFIER") {
-        throw std::runtime_error("Expected function name after 'fn'");
+    if (atEnd() || current().type != TokenType::IDENTIFIER) {
+        error("Expected function name after 'fn'");
+        return;
     }
-    std::string name = current().value;
+    Symbol name = current().symbol;
     advance();
 
-    expect("PUNCTUATION", "(");
-    expect("PUNCTUATION", ")");
-
-    auto body = parseBlock();
+    if (!expect(TokenType::LPAREN) || !expect(TokenType::RPAREN)) return;
 
-    return std::make_unique<FunctionDecl>(name, std::move(body));
+    size_t bodyMark = b.mark();
+    size_t bodyBlock = 0;
+    if (!enterBlock(b, bodyBlock)) return;
+    b.open.push_back({SyntaxMap::Owner::Function, checkpoint, {}, name, bodyMark, 0, bodyBlock, SyntaxMap::kNone});
 }
 
 // Parse: let [mut] name = expr ;
-std::unique_ptr<ASTNode> Parser::parseLetDecl() {
-    expect("KEYWORD", "let");
+template <class B>
+typename B::Ref Parser::parseLetDecl(B& b) {
+    expect(TokenType::KW_LET);
 
     bool isMut = false;
-    if (!atEnd() && current().type == "KEYWORD" && current().value == "mut") {
+    if (!atEnd() && current().type == TokenType::KW_MUT) {
         isMut = true;
         advance();
     }
 
-    if (atEnd() || current().type != "IDENTIFIER") {
-        throw std::runtime_error("Expected variable name after 'let'");
+    if (atEnd() || current().type != TokenType::IDENTIFIER) {
+        error("Expected variable name after 'let'");
+        return {};
     }
-    std::string name = current().value;
+    Symbol name = current().symbol;
     advance();
 
-    expect("OPERATOR", "=");
+    if (!expect(TokenType::ASSIGN)) return {};
 
-    auto value = parseExpression();
+    auto value = parseExpression(b);
 
-    expect("PUNCTUATION", ";");
+    if (failed_ || !expect(TokenType::SEMICOLON)) return {};
 
-    return std::make_unique<LetDecl>(name, isMut, std::move(value));
+    return b.let(name, isMut, value);
 }
 
 // Parse a primary value: number, string, or identifier
-std::unique_ptr<ASTNode> Parser::parsePrimary() {
+template <class B>
+typename B::Ref Parser::parsePrimary(B& b) {
     if (atEnd()) {
-        throw std::runtime_error("Unexpected end of input while parsing expression");
+        error("Unexpected end of input while parsing expression");
+        return {};
     }
 
     const Token& tok = current();
 
-    if (tok.type == "NUMBER") {
-        advance();
-        return std::make_unique<NumberLiteral>(tok.value);
+    switch (tok.type) {
+        case TokenType::NUMBER:
+            advance();
+            return b.number(tok.value);
+        case TokenType::STRING:
+            advance();
+            return b.string(tok.value);
+        case TokenType::IDENTIFIER:
+            advance();
+            return b.identifier(tok.symbol);
+        default:
+            break;
     }
 
-    if (tok.type == "STRING") {
-        advance();
-        return std::make_unique<StringLiteral>(tok.value);
-    }
+    error(std::string("Unexpected token: ") + tokenCategory(tok.type) + " '" + std::string(tok.value) + "'");
+    return {};
+}
 
-    if (tok.type == "IDENTIFIER") {
-        advance();
-        return std::make_unique<Identifier>(tok.value);
-    }
+// Parse: if expr {
+// The else branch is picked up by parseListItem() when the then block closes.
+template <class B>
+void Parser::parseIfStatement(B& b, const typename B::Checkpoint& checkpoint) {
+    expect(TokenType::KW_IF);
+
+    auto condition = parseExpression(b);
+    if (failed_) return;
+    size_t thenMark = b.mark();
+    size_t thenBlock = 0;
+    if (!enterBlock(b, thenBlock)) return;
+    b.open.push_back({SyntaxMap::Owner::Then, checkpoint, condition, Symbol{}, thenMark, 0, thenBlock,
+                      SyntaxMap::kNone});
+}
+
+// Parse: return expr ;
+template <class B>
+typename B::Ref Parser::parseReturnStatement(B& b) {
+    expect(TokenType::KW_RETURN);
+
+    auto value = parseExpression(b);
 
-    throw std::runtime_error("Unexpected token: " + tok.type + " '" + tok.value + "'");
+    if (failed_ || !expect(TokenType::SEMICOLON)) return {};
+
+    return b.ret(value);
 }
 
-// Parse: if expr { body } [else { body }]
-std::unique_ptr<ASTNode> Parser::parseIfStatement() {
-    expect("KEYWORD", "if");
+// Parse: while expr {
+template <class B>
+void Parser::parseWhileStatement(B& b, const typename B::Checkpoint& checkpoint) {
+    expect(TokenType::KW_WHILE);
+
+    auto condition = parseExpression(b);
+    if (failed_) return;
+    size_t bodyMark = b.mark();
+    size_t bodyBlock = 0;
+    if (!enterBlock(b, bodyBlock)) return;
+    b.open.push_back({SyntaxMap::Owner::While, checkpoint, condition, Symbol{}, bodyMark, 0, bodyBlock,
+                      SyntaxMap::kNone});
+}
 
-    auto condition = parseExpression();
-    auto thenBody = parseBlock();
+// Parse expression: primary, optionally followed by operator + primary
+template <class B>
+typename B::Ref Parser::parseExpression(B& b) {
+    auto left = parsePrimary(b);
 
-    std::vector<std::unique_ptr<ASTNode>> elseBody;
-    if (!atEnd() && current().type == "KEYWORD" && current().value == "else") {
+    // If next token is an operator, parse binary expression
+    while (!failed_ && !atEnd() && isOperator(current().type)) {
+        BinaryOp op = binaryOpFor(current().type);
         advance();
-        elseBody = parseBlock();
+        auto right = parsePrimary(b);
+        if (failed_) return {};
+        left = b.binary(op, left, right);
     }
 
-    return std::make_unique<IfStatement>(std::move(condition), std::move(thenBody), std::move(elseBody));
+    return left;
 }
 
-// Parse: return expr ;
-std::unique_ptr<ASTNode> Parser::parseReturnStatement() {
-    expect("KEYWORD", "return");
+// --- Incremental reparsing ---
+
+namespace {
+
+// Turns the blocks a recorder collected into map items, one per recorded
+// top-level item
+void collectItems(const BlockRecorder& recorder, std::vector<SyntaxMap::Item>& items) {
+    size_t next = 0;
+    for (size_t i = 0; i < recorder.itemStarts.size(); ++i) {
+        SyntaxMap::Item item;
+        item.start = recorder.itemStarts[i];
+        size_t base = next;
+        size_t end = i + 1 < recorder.itemStarts.size() ? recorder.itemStarts[i + 1] : SIZE_MAX;
+        while (next < recorder.blocks.size() && recorder.blocks[next].open < end) {
+            SyntaxMap::Block b = recorder.blocks[next++];
+            b.open -= static_cast<uint32_t>(item.start);
+            b.close -= static_cast<uint32_t>(item.start);
+            if (b.parent != SyntaxMap::kNone) b.parent -= static_cast<uint32_t>(base);
+            item.blocks.push_back(b);
+        }
+        items.push_back(std::move(item));
+    }
+}
 
-    auto value = parseExpression();
+const NodeList& listOf(const ASTNode* node, SyntaxMap::Owner owner) {
+    switch (owner) {
+        case SyntaxMap::Owner::Function: return static_cast<const FunctionDecl*>(node)->body;
+        case SyntaxMap::Owner::Then:     return static_cast<const IfStatement*>(node)->thenBody;
+        case SyntaxMap::Owner::Else:     return static_cast<const IfStatement*>(node)->elseBody;
+        case SyntaxMap::Owner::While:    break;
+    }
+    return static_cast<const WhileStatement*>(node)->body;
+}
 
-    expect("PUNCTUATION", ";");
+// A copy of `node` with its `owner` list replaced
+ASTNode* withList(const ASTNode* node, SyntaxMap::Owner owner, NodeList list, Arena& arena) {
+    switch (owner) {
+        case SyntaxMap::Owner::Function: {
+            auto* fn = static_cast<const FunctionDecl*>(node);
+            return arena.make<FunctionDecl>(fn->name, list);
+        }
+        case SyntaxMap::Owner::Then: {
+            auto* stmt = static_cast<const IfStatement*>(node);
+            return arena.make<IfStatement>(stmt->condition, list, stmt->elseBody);
+        }
+        case SyntaxMap::Owner::Else: {
+            auto* stmt = static_cast<const IfStatement*>(node);
+            return arena.make<IfStatement>(stmt->condition, stmt->thenBody, list);
+        }
+        case SyntaxMap::Owner::While:
+            break;
+    }
+    auto* loop = static_cast<const WhileStatement*>(node);
+    return arena.make<WhileStatement>(loop->condition, list);
+}
 
-    return std::make_unique<ReturnStatement>(std::move(value));
+// A copy of `list` with entry `slot` replaced
+NodeList replaced(const NodeList& list, size_t slot, ASTNode* node, Arena& arena,
+                  std::vector<ASTNode*>& scratch) {
+    scratch.assign(list.begin(), list.end());
+    scratch[slot] = node;
+    return NodeList(scratch.data(), scratch.size(), arena);
 }
 
-// Parse: while expr { body }
-std::unique_ptr<ASTNode> Parser::parseWhileStatement() {
-    expect("KEYWORD", "while");
+} // namespace
+
+void SyntaxMap::shift(size_t item, ptrdiff_t delta) {
+    if (delta == 0 || item >= items.size()) return;
+    auto move = [&](size_t from, size_t to, ptrdiff_t by) {
+        for (size_t i = from; i < to; ++i) {
+            items[i].start = static_cast<size_t>(static_cast<ptrdiff_t>(items[i].start) + by);
+        }
+    };
+    if (shiftFrom >= items.size()) {
+        shiftFrom = item;
+        shiftBy = delta;
+    } else if (item >= shiftFrom) {
+        move(shiftFrom, item, shiftBy);
+        shiftFrom = item;
+        shiftBy += delta;
+    } else {
+        move(item, shiftFrom, delta);
+        shiftBy += delta;
+    }
+}
 
-    auto condition = parseExpression();
-    auto body = parseBlock();
+void SyntaxMap::settle() {
+    for (size_t i = shiftFrom; i < items.size(); ++i) {
+        items[i].start = static_cast<size_t>(static_cast<ptrdiff_t>(items[i].start) + shiftBy);
+    }
+    shiftFrom = SIZE_MAX;
+    shiftBy = 0;
+}
 
-    return std::make_unique<WhileStatement>(std::move(condition), std::move(body));
+ParseResult<Program> Parser::parse(const std::vector<Token>& tokens, SyntaxMap& map) {
+    start(tokens);
+    ParseResult<Program> result;
+    BlockRecorder recorder;
+    TreeBuilder builder{result.ast, pending_, &recorder};
+    parseProgram(builder);
+    result.diagnostics = std::move(diagnostics_);
+    map.items.clear();
+    map.shiftFrom = SIZE_MAX;
+    map.shiftBy = 0;
+    collectItems(recorder, map.items);
+    map.liveBytes = result.ast.arena.bytesUsed();
+    return result;
 }
 
-// Parse expression: primary, optionally followed by operator + primary
-std::unique_ptr<ASTNode> Parser::parseExpression() {
-    auto left = parsePrimary();
+ParseResult<Program> Parser::reparse(ParseResult<Program> previous, SyntaxMap& map,
+                                     const std::vector<Token>& tokens, const TokenEdit& edit) {
+    // Past this, the replaced nodes outweigh the live tree
+    bool compact = previous.ast.arena.bytesUsed() > 2 * map.liveBytes;
+    if (previous.ok() && !compact) {
+        start(tokens);
+        if (reparseBlock(previous.ast, map, tokens, edit) || reparseItems(previous.ast, map, edit)) {
+            return previous;
+        }
+    }
+    return parse(tokens, map);
+}
 
-    // If next token is an operator, parse binary expression
-    while (!atEnd() && current().type == "OPERATOR") {
-        std::string op = current().value;
-        advance();
-        auto right = parsePrimary();
-        left = std::make_unique<BinaryExpr>(op, std::move(left), std::move(right));
+// Re-parses the smallest block around the edit that still parses on its
+// own, and copies the statements on its path up to the top-level item
+bool Parser::reparseBlock(Program& program, SyntaxMap& map, const std::vector<Token>& tokens,
+                          const TokenEdit& edit) {
+    // The last item that starts at or before the edit
+    size_t lo = 0;
+    size_t hi = map.items.size();
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (map.start(mid) <= edit.first) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) return false;
+    size_t index = lo - 1;
+    SyntaxMap::Item& item = map.items[index];
+    const size_t itemStart = map.start(index);
+    const ptrdiff_t delta = static_cast<ptrdiff_t>(edit.newCount) - static_cast<ptrdiff_t>(edit.oldCount);
+    const size_t first = edit.first - itemStart;
+    const size_t last = first + edit.oldCount;   // one past the replaced tokens
+
+    // Innermost block whose braces are both outside the edit: in opening
+    // order, the last one that encloses it
+    uint32_t target = SyntaxMap::kNone;
+    for (uint32_t i = 0; i < item.blocks.size() && item.blocks[i].open < first; ++i) {
+        if (item.blocks[i].close >= last) target = i;
     }
 
-    return left;
+    for (; target != SyntaxMap::kNone; target = item.blocks[target].parent) {
+        const SyntaxMap::Block& block = item.blocks[target];
+        size_t open = itemStart + block.open;
+        size_t close = static_cast<size_t>(static_cast<ptrdiff_t>(itemStart + block.close) + delta);
+
+        // The braces must still pair up around the new contents
+        size_t match = open;
+        for (int nesting = 0; match < tokens.size(); ++match) {
+            TokenType type = tokens[match].type;
+            if (type == TokenType::LBRACE) {
+                nesting++;
+            } else if (type == TokenType::RBRACE && --nesting == 0) {
+                break;
+            }
+        }
+        if (match != close) continue;
+
+        reset(open);
+        BlockRecorder recorder;
+        TreeBuilder builder{program, pending_, &recorder};
+        parseBlock(builder);
+        if (!diagnostics_.empty() || pos_ != close + 1) continue;
+
+        // Rebuild the statement that owns the block, then each enclosing one
+        std::vector<ASTNode*> scratch;
+        std::vector<std::pair<ASTNode*, ASTNode*>> copies;
+        ASTNode* node = withList(block.node, block.owner, builder.take(0, pending_.size()), program.arena);
+        copies.emplace_back(block.node, node);
+        for (uint32_t at = target; item.blocks[at].parent != SyntaxMap::kNone;) {
+            const SyntaxMap::Block& child = item.blocks[at];
+            const SyntaxMap::Block& parent = item.blocks[child.parent];
+            NodeList list = replaced(listOf(parent.node, parent.owner), child.slot, node, program.arena, scratch);
+            node = withList(parent.node, parent.owner, list, program.arena);
+            copies.emplace_back(parent.node, node);
+            at = child.parent;
+        }
+        program.items.set(index, node);
+
+        // Swap the block's descendants for the freshly recorded ones, and
+        // move everything after the edit
+        uint32_t end = target + 1;
+        while (end < item.blocks.size() && item.blocks[end].open < block.close) end++;
+        std::vector<SyntaxMap::Block> fresh;
+        for (size_t i = 0; i < recorder.blocks.size(); ++i) {
+            SyntaxMap::Block b = recorder.blocks[i];
+            b.open -= static_cast<uint32_t>(itemStart);
+            b.close -= static_cast<uint32_t>(itemStart);
+            b.parent = i == 0 ? block.parent : b.parent + target;
+            if (i == 0) {
+                b.slot = block.slot;
+                b.owner = block.owner;
+                b.node = block.node;
+            }
+            fresh.push_back(b);
+        }
+        int32_t grown = static_cast<int32_t>(fresh.size()) - static_cast<int32_t>(end - target);
+        for (size_t i = 0; i < item.blocks.size(); ++i) {
+            SyntaxMap::Block& b = item.blocks[i];
+            if (i >= end) {
+                b.open = static_cast<uint32_t>(b.open + delta);
+                if (b.parent != SyntaxMap::kNone && b.parent >= end) b.parent += grown;
+            }
+            if (b.close >= last) b.close = static_cast<uint32_t>(b.close + delta);
+        }
+        item.blocks.erase(item.blocks.begin() + target, item.blocks.begin() + end);
+        item.blocks.insert(item.blocks.begin() + target, fresh.begin(), fresh.end());
+        for (SyntaxMap::Block& b : item.blocks) {
+            for (const auto& copy : copies) {
+                if (b.node == copy.first) b.node = copy.second;
+            }
+        }
+        map.shift(index + 1, delta);
+        return true;
+    }
+    return false;
+}
+
+// Re-parses top-level items from the last one that ends at or after the
+// edit (it may have looked at the first edited token) until an item starts
+// where a shifted old one did
+bool Parser::reparseItems(Program& program, SyntaxMap& map, const TokenEdit& edit) {
+    map.settle();
+    std::vector<SyntaxMap::Item>& items = map.items;
+    const ptrdiff_t delta = static_cast<ptrdiff_t>(edit.newCount) - static_cast<ptrdiff_t>(edit.oldCount);
+    const size_t editEnd = edit.first + edit.newCount;
+
+    size_t from = 0;
+    while (from + 1 < items.size() && items[from + 1].start < edit.first) from++;
+    size_t to = from;    // old items [from, to) are replaced
+
+    reset(items.empty() ? 0 : items[from].start);
+    BlockRecorder recorder;
+    TreeBuilder builder{program, pending_, &recorder};
+    while (!atEnd()) {
+        if (pos_ >= editEnd) {
+            size_t oldStart = static_cast<size_t>(static_cast<ptrdiff_t>(pos_) - delta);
+            while (to < items.size() && items[to].start < oldStart) to++;
+            if (to < items.size() && items[to].start == oldStart) break;
+        }
+        builder.item(pos_);
+        parseListItem(builder);
+        if (!diagnostics_.empty()) return false;
+    }
+    if (atEnd()) to = items.size();
+
+    std::vector<ASTNode*> list(program.items.begin(), program.items.begin() + from);
+    list.insert(list.end(), pending_.begin(), pending_.end());
+    list.insert(list.end(), program.items.begin() + to, program.items.end());
+    program.items = NodeList(list.data(), list.size(), program.arena);
+
+    std::vector<SyntaxMap::Item> fresh;
+    collectItems(recorder, fresh);
+    for (size_t i = to; i < items.size(); ++i) {
+        items[i].start = static_cast<size_t>(static_cast<ptrdiff_t>(items[i].start) + delta);
+    }
+    items.erase(items.begin() + from, items.begin() + to);
+    items.insert(items.begin() + from, std::make_move_iterator(fresh.begin()), std::make_move_iterator(fresh.end()));
+    return true;
 }
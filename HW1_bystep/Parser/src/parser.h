@@ -1,35 +1,188 @@
 #ifndef PARSER_H
 #define PARSER_H
 
+#include <cstddef>
+#include <cstdint>
+#include <string>
 #include <vector>
-#include <memory>
-#include <stdexcept>
 #include "lexer.h"
 #include "ast.h"
+#include "flat_ast.h"
+
+// A syntax error. `token` is the index of the token it was reported at.
+struct Diagnostic {
+    std::string message;
+    size_t token;
+};
+
+// The AST plus every error the parser recovered from. After an error the
+// parser skips ahead to the next `;` or `}` and carries on, so the AST holds
+// the statements that parsed cleanly and `diagnostics` lists all the errors
+// of the input in order.
+template <class Ast>
+struct ParseResult {
+    Ast ast;
+    std::vector<Diagnostic> diagnostics;
+
+    bool ok() const { return diagnostics.empty(); }
+};
+
+// Tokens [first, first + oldCount) of the previous token vector were
+// replaced by tokens [first, first + newCount) of the current one.
+struct TokenEdit {
+    size_t first;
+    size_t oldCount;
+    size_t newCount;
+};
+
+// Where the top-level items and the blocks of a Program came from. Recorded
+// by Parser::parse(tokens, map) and kept up to date by Parser::reparse(),
+// which uses it to find the block an edit falls in. Only meaningful for a
+// parse without errors.
+struct SyntaxMap {
+    static constexpr uint32_t kNone = 0xFFFFFFFFu;
+
+    // Which list of which statement a block holds
+    enum class Owner : uint8_t { Function, Then, Else, While };
+
+    // A `{ ... }` list. Token indices are relative to the start of the item.
+    struct Block {
+        uint32_t open;
+        uint32_t close;
+        uint32_t parent;     // enclosing block of the same item, or kNone
+        uint32_t slot;       // index of `node` in the parent block's list
+        Owner owner;
+        ASTNode* node;       // the statement the list belongs to
+    };
+
+    // A top-level statement and its blocks, in the order they open
+    struct Item {
+        size_t start;        // first token, before any pending shift
+        std::vector<Block> blocks;
+    };
+
+    std::vector<Item> items;
+
+    // Edits move the items after them. The move is applied lazily: items
+    // from `shiftFrom` on are `shiftBy` tokens further than Item::start says,
+    // and a new shift only updates the items between it and the pending one,
+    // so a run of edits in one place does not touch the rest of the file.
+    size_t shiftFrom = SIZE_MAX;
+    ptrdiff_t shiftBy = 0;
+
+    // Arena bytes used by the tree of the last full parse
+    size_t liveBytes = 0;
+
+    size_t start(size_t item) const {
+        return static_cast<size_t>(static_cast<ptrdiff_t>(items[item].start) + (item >= shiftFrom ? shiftBy : 0));
+    }
+
+    // Moves the items from `item` on by `delta` tokens
+    void shift(size_t item, ptrdiff_t delta);
+
+    // Applies the pending shift to every Item::start
+    void settle();
+};
 
 class Parser {
 public:
-    std::vector<std::unique_ptr<ASTNode>> parse(const std::vector<Token>& tokens);
+    // Parse a pre-tokenized program. The returned Program owns every node.
+    ParseResult<Program> parse(const std::vector<Token>& tokens);
+
+    // Parse while pulling tokens from the lexer on demand. Only a small window
+    // of lookahead tokens is held at any time, so memory does not grow with
+    // the length of the input.
+    ParseResult<Program> parse(Lexer& lexer);
+
+    // Same as parse(tokens), and records the block structure in `map` for
+    // reparse()
+    ParseResult<Program> parse(const std::vector<Token>& tokens, SyntaxMap& map);
+
+    // Brings `previous`, a parse of the old tokens made with `map`, up to
+    // date with `tokens` after `edit`. The result is identical to a full
+    // parse of `tokens`.
+    //
+    // The smallest block that encloses the edit, braces excluded, and still
+    // matches up in the new tokens is parsed again, and only the statements
+    // on its path to the top level are copied; every other subtree is reused.
+    // An edit outside all blocks re-parses top-level items from the one
+    // before the edit until the items line up with the old ones again. Any
+    // syntax error, old or new, falls back to a full parse.
+    //
+    // The new nodes go into the previous program's arena, and the replaced
+    // ones stay there until the next full parse. An edit between items also
+    // rebuilds the top-level list, which costs time and arena space linear
+    // in the number of items. Once the arena has grown by more than the tree
+    // of the last full parse, reparse() does a full parse instead, which
+    // starts a fresh arena; the dead nodes never outweigh the live ones.
+    ParseResult<Program> reparse(ParseResult<Program> previous, SyntaxMap& map,
+                                 const std::vector<Token>& tokens, const TokenEdit& edit);
+
+    // Same grammar, but builds the index-based representation directly
+    ParseResult<FlatAst> parseFlat(const std::vector<Token>& tokens);
+    ParseResult<FlatAst> parseFlat(Lexer& lexer);
+
+    // Deepest block nesting seen by the last parse (by reparse(), of what it
+    // parsed again)
+    int maxDepth() const { return maxDepth_; }
 
 private:
+    // Streaming mode: ring buffer of the most recently pulled tokens
+    static constexpr int kWindow = 4;
+
     const std::vector<Token>* tokens_ = nullptr;
-    int pos_ = 0;
+    Lexer* lexer_ = nullptr;
+    Token window_[kWindow];
+    size_t pulled_ = 0;    // number of tokens pulled from lexer_ so far
+    size_t pos_ = 0;
+
+    // Statements whose enclosing block is still open, for the tree and the
+    // flat builder. Each block pushes its children on top and turns them
+    // into a list when it closes.
+    std::vector<ASTNode*> pending_;
+    std::vector<uint32_t> flatPending_;
+
+    // Errors are recorded instead of thrown. `failed_` is set from the first
+    // error in a statement until the parser has resynchronized, and unwinds
+    // the grammar functions through plain returns.
+    std::vector<Diagnostic> diagnostics_;
+    bool failed_ = false;
+    int depth_ = 0;        // number of open blocks
+    int maxDepth_ = 0;
 
-    const Token& current() const;
-    const Token& peek() const;
-    bool atEnd() const;
+    const Token& tokenAt(size_t index);
+    const Token& current();
+    const Token& peek();
+    bool atEnd();
     const Token& advance();
-    void expect(const std::string& type, const std::string& value);
-
-    std::unique_ptr<ASTNode> parseExpression();
-    std::unique_ptr<ASTNode> parsePrimary();
-    std::unique_ptr<ASTNode> parseStatement();
-    std::unique_ptr<ASTNode> parseLetDecl();
-    std::unique_ptr<ASTNode> parseFunctionDecl();
-    std::vector<std::unique_ptr<ASTNode>> parseBlock();
-    std::unique_ptr<ASTNode> parseIfStatement();
-    std::unique_ptr<ASTNode> parseWhileStatement();
-    std::unique_ptr<ASTNode> parseReturnStatement();
+    bool expect(TokenType type);
+    void error(std::string message);
+    void synchronize();
+
+    void start(const std::vector<Token>& tokens);
+    void start(Lexer& lexer);
+    void reset(size_t pos);
+
+    bool reparseBlock(Program& program, SyntaxMap& map, const std::vector<Token>& tokens,
+                      const TokenEdit& edit);
+    bool reparseItems(Program& program, SyntaxMap& map, const TokenEdit& edit);
+
+    // The grammar is written once against a builder interface (see
+    // parser.cpp) that either allocates tree nodes or appends flat ones.
+    template <class B> void parseProgram(B& b);
+    template <class B> void parseListItem(B& b);
+    template <class B> void endListItem(B& b, const typename B::Checkpoint& checkpoint, typename B::Ref stmt);
+    template <class B> typename B::Ref parseExpression(B& b);
+    template <class B> typename B::Ref parsePrimary(B& b);
+    template <class B> typename B::Ref parseStatement(B& b, const typename B::Checkpoint& checkpoint);
+    template <class B> typename B::Ref parseLetDecl(B& b);
+    template <class B> void parseFunctionDecl(B& b, const typename B::Checkpoint& checkpoint);
+    template <class B> bool enterBlock(B& b, size_t& block);
+    template <class B> void leaveBlock(B& b);
+    template <class B> size_t parseBlock(B& b);
+    template <class B> void parseIfStatement(B& b, const typename B::Checkpoint& checkpoint);
+    template <class B> void parseWhileStatement(B& b, const typename B::Checkpoint& checkpoint);
+    template <class B> typename B::Ref parseReturnStatement(B& b);
 };
 
 #endif
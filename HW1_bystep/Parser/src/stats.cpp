@@ -0,0 +1,103 @@
+#include "stats.h"
+#include <string>
+#include <vector>
+
+namespace {
+
+const char* const kPhaseNames[RunStats::kPhases] = {"read", "lex", "parse", "print"};
+
+const char* const kNodeNames[RunStats::kNodeKinds] = {
+    "NumberLiteral", "Identifier", "StringLiteral", "BinaryExpr", "LetDecl",
+    "FunctionDecl", "IfStatement", "WhileStatement", "ReturnStatement",
+};
+
+// Spelling of keywords, operators and punctuation, category of the rest
+std::string tokenName(size_t type) {
+    const char* spelling = tokenSpelling(static_cast<TokenType>(type));
+    return *spelling ? spelling : tokenCategory(static_cast<TokenType>(type));
+}
+
+std::string nodeName(size_t kind) {
+    return kNodeNames[kind];
+}
+
+} // namespace
+
+void RunStats::countNodes(const Program& program) {
+    if constexpr (!kStatsEnabled) return;
+    // Walked with a heap stack, like the printer, so depth does not matter
+    std::vector<const ASTNode*> stack(program.begin(), program.end());
+    auto pushList = [&](const NodeList& list) { stack.insert(stack.end(), list.begin(), list.end()); };
+    while (!stack.empty()) {
+        const ASTNode* node = stack.back();
+        stack.pop_back();
+        NodeKind kind = node->kind();
+        nodes[static_cast<size_t>(kind)]++;
+        switch (kind) {
+            case NodeKind::Number:
+            case NodeKind::Identifier:
+            case NodeKind::String:
+                break;
+            case NodeKind::Binary: {
+                auto* binary = static_cast<const BinaryExpr*>(node);
+                stack.push_back(binary->left);
+                stack.push_back(binary->right);
+                break;
+            }
+            case NodeKind::Let:
+                stack.push_back(static_cast<const LetDecl*>(node)->value);
+                break;
+            case NodeKind::Return:
+                stack.push_back(static_cast<const ReturnStatement*>(node)->value);
+                break;
+            case NodeKind::Function:
+                pushList(static_cast<const FunctionDecl*>(node)->body);
+                break;
+            case NodeKind::If: {
+                auto* stmt = static_cast<const IfStatement*>(node);
+                stack.push_back(stmt->condition);
+                pushList(stmt->thenBody);
+                pushList(stmt->elseBody);
+                break;
+            }
+            case NodeKind::While: {
+                auto* loop = static_cast<const WhileStatement*>(node);
+                stack.push_back(loop->condition);
+                pushList(loop->body);
+                break;
+            }
+        }
+    }
+}
+
+const char* phaseName(Phase phase) {
+    return kPhaseNames[static_cast<size_t>(phase)];
+}
+
+uint64_t RunStats::tokenCount() const {
+    uint64_t n = 0;
+    for (uint64_t c : tokens) n += c;
+    return n;
+}
+
+uint64_t RunStats::nodeCount() const {
+    uint64_t n = 0;
+    for (uint64_t c : nodes) n += c;
+    return n;
+}
+
+void RunStats::merge(const RunStats& other) {
+    PhaseStats::merge(other);
+    for (size_t i = 0; i < kTokenTypes; ++i) tokens[i] += other.tokens[i];
+    for (size_t i = 0; i < kNodeKinds; ++i) nodes[i] += other.nodes[i];
+}
+
+void RunStats::writeText(std::ostream& out) const {
+    PhaseStats::writeText(out, kPhaseNames, kPhases,
+                          {{"tokens", tokens, kTokenTypes, tokenName}, {"nodes", nodes, kNodeKinds, nodeName}});
+}
+
+void RunStats::writeJson(std::ostream& out) const {
+    PhaseStats::writeJson(out, kPhaseNames, kPhases,
+                          {{"tokens", tokens, kTokenTypes, tokenName}, {"nodes", nodes, kNodeKinds, nodeName}});
+}
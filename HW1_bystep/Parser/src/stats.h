@@ -0,0 +1,59 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include "ast.h"
+#include "common/stats.h"
+#include "lexer.h"
+
+// The counters behind `rustparser --stats`, on top of the phase timing of
+// common/stats.h. Built only with PARSER_STATS=1 (the CMake option of the
+// same name, on by default); otherwise PhaseTimer, the counting calls and the
+// lexer's token counter compile to nothing and the CLI rejects --stats.
+
+// Read only opens (maps) the file: its pages are faulted in by the first
+// pass over them, usually lexing. With --stream lexing happens inside Parse.
+enum class Phase : uint8_t { Read, Lex, Parse, Print };
+
+// "read", "lex", "parse" or "print"
+const char* phaseName(Phase phase);
+
+struct RunStats : PhaseStats {
+    static constexpr size_t kPhases = 4;
+    static_assert(kPhases <= kMaxPhases, "PhaseStats keeps kMaxPhases phases");
+    static constexpr size_t kTokenTypes = static_cast<size_t>(TokenType::END_OF_FILE) + 1;
+    static constexpr size_t kNodeKinds = static_cast<size_t>(NodeKind::Return) + 1;
+
+    uint64_t tokens[kTokenTypes] = {};  // filled by Lexer::countTokens()
+    uint64_t nodes[kNodeKinds] = {};
+
+    void nested(int depth) {
+        if constexpr (kStatsEnabled) {
+            if (static_cast<uint32_t>(depth) > maxDepth) maxDepth = static_cast<uint32_t>(depth);
+        }
+    }
+
+    // Counts the nodes of a tree, or of a FlatAst or AstImage
+    void countNodes(const Program& program);
+    template <class Flat>
+    void countNodes(const Flat& ast) {
+        if constexpr (kStatsEnabled) {
+            for (uint32_t i = 0; i < ast.size(); ++i) nodes[static_cast<size_t>(ast.kind(i))]++;
+        }
+    }
+
+    uint64_t tokenCount() const;
+    uint64_t nodeCount() const;
+
+    // Adds the counts and times of `other`, e.g. another worker's
+    void merge(const RunStats& other);
+
+    // A table for people, or one JSON object on a single line. With
+    // kAllocStatsEnabled both include the heap allocations of the run.
+    void writeText(std::ostream& out) const;
+    void writeJson(std::ostream& out) const;
+};
+
+#endif
@@ -0,0 +1,750 @@
+#include "ast_image.h"
+#include "lexer.h"
+#include "parser.h"
+#include "stats.h"
+#include "common/trace.h"
+#include "interner.h"
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <cstring>
+#include <functional>
+#include <thread>
+#include <vector>
+
+static std::ostream& operator<<(std::ostream& os, TokenType type) {
+    return os << tokenCategory(type) << " #" << static_cast<int>(type);
+}
+
+static std::ostream& operator<<(std::ostream& os, NodeKind kind) {
+    return os << "NodeKind #" << static_cast<int>(kind);
+}
+
+// Simple test macros
+static int test_failures = 0;
+static int test_assertions = 0;
+
+#define ASSERT_EQ(expected, actual) do { \
+    test_assertions++; \
+    if ((expected) != (actual)) { \
+        std::cerr << "  FAIL at line " << __LINE__ << ": expected '" << (expected) \
+                  << "' but got '" << (actual) << "'" << std::endl; \
+        test_failures++; \
+    } \
+} while(0)
+
+static const char* kProgram =
+    "fn main() {\n"
+    "    let mut x = 10;\n"
+    "    while x > 0 {\n"
+    "        if x == 5 { return x; } else { let s = \"hi\"; }\n"
+    "        let x = x - 1;\n"
+    "    }\n"
+    "}\n";
+
+static const char* kProgramAst =
+    "FunctionDecl(main)\n"
+    "  LetDecl(mut x)\n"
+    "    NumberLiteral(10)\n"
+    "  WhileStatement\n"
+    "    Condition:\n"
+    "      BinaryExpr(>)\n"
+    "        Identifier(x)\n"
+    "        NumberLiteral(0)\n"
+    "    Body:\n"
+    "      IfStatement\n"
+    "        Condition:\n"
+    "          BinaryExpr(==)\n"
+    "            Identifier(x)\n"
+    "            NumberLiteral(5)\n"
+    "        Then:\n"
+    "          ReturnStatement\n"
+    "            Identifier(x)\n"
+    "        Else:\n"
+    "          LetDecl(s)\n"
+    "            StringLiteral(\"hi\")\n"
+    "      LetDecl(x)\n"
+    "        BinaryExpr(-)\n"
+    "          Identifier(x)\n"
+    "          NumberLiteral(1)\n";
+
+static std::string dump(const Program& ast) {
+    std::string out;
+    for (const ASTNode* node : ast) {
+        out += node->toString() + "\n";
+    }
+    return out;
+}
+
+// ---- Test cases ----
+
+void test_parse_program() {
+    Lexer lexer;
+    auto tokens = lexer.tokenize(kProgram);
+    Parser parser;
+    auto ast = parser.parse(tokens).ast;
+    ASSERT_EQ(std::string(kProgramAst), dump(ast));
+}
+
+void test_parse_stream() {
+    // Pulling tokens on demand builds the same tree
+    Lexer lexer(kProgram);
+    Parser parser;
+    auto ast = parser.parse(lexer).ast;
+    ASSERT_EQ(std::string(kProgramAst), dump(ast));
+}
+
+void test_output_buffer() {
+    // A tiny capacity forces several hand-offs to the stream mid-tree
+    Lexer lexer;
+    auto tokens = lexer.tokenize(kProgram);
+    Parser parser;
+    auto ast = parser.parse(tokens).ast;
+    std::ostringstream stream;
+    {
+        OutputBuffer out(stream, 16);
+        AstWriter writer(out);
+        printProgram(ast, writer);
+        ASSERT_EQ(true, stream.str().size() > 0);
+    }
+    ASSERT_EQ(std::string(kProgramAst), stream.str());
+
+    // In-memory buffers keep everything until taken
+    OutputBuffer memory;
+    memory << "a" << 'b' << std::string_view("c");
+    memory.flush();
+    ASSERT_EQ(std::string("abc"), memory.take());
+    ASSERT_EQ(std::string(""), memory.str());
+}
+
+void test_flat_ast() {
+    // The flat printer and the flat-to-tree converter both reproduce the
+    // tree output, including the odd spacing after an empty function body
+    std::string source = std::string(kProgram) + "fn empty() {}\nif a { } \nwhile b {}\n";
+    Lexer lexer;
+    auto tokens = lexer.tokenize(source);
+    Parser parser;
+    std::string expected = dump(parser.parse(tokens).ast);
+    FlatAst flat = parser.parseFlat(tokens).ast;
+    ASSERT_EQ(expected, printFlatAst(flat));
+    ASSERT_EQ(expected, dump(toProgram(flat)));
+    ASSERT_EQ(size_t(4), flat.roots().size());
+
+    Lexer streamLexer(source);
+    ASSERT_EQ(expected, printFlatAst(parser.parseFlat(streamLexer).ast));
+}
+
+void test_flat_post_order() {
+    Lexer lexer;
+    auto tokens = lexer.tokenize(kProgram);
+    Parser parser;
+    FlatAst flat = parser.parseFlat(tokens).ast;
+    // Every child index is smaller than its parent's
+    for (uint32_t i = 0; i < flat.size(); ++i) {
+        switch (flat.kinds[i]) {
+            case NodeKind::Binary:
+                ASSERT_EQ(true, flat.left(i) < FlatAst::operand(i));
+                break;
+            case NodeKind::If:
+                for (uint32_t child : flat.elseBody(i)) ASSERT_EQ(true, child < i);
+                [[fallthrough]];
+            case NodeKind::While:
+                ASSERT_EQ(true, flat.condition(i) < i);
+                break;
+            default:
+                break;
+        }
+    }
+    // The function is the last node, and the operator is stored as an enum
+    ASSERT_EQ(NodeKind::Function, flat.kinds.back());
+    ASSERT_EQ(true, flat.op(flat.condition(flat.body(flat.size() - 1)[1])) == BinaryOp::Greater);
+}
+
+void test_parse_errors() {
+    // Each broken statement is reported and skipped; the rest still parses.
+    // The return inside the if fails on its own, leaving an empty Then.
+    const char* source =
+        "let = 5;\n"
+        "fn main() {\n"
+        "    let x = ;\n"
+        "    if x { return 1 } \n"
+        "    let y = 2;\n"
+        "}\n"
+        "} let z = 3;\n"
+        "while x {";
+    Lexer lexer;
+    auto tokens = lexer.tokenize(source);
+    Parser parser;
+    auto result = parser.parse(tokens);
+    ASSERT_EQ(false, result.ok());
+    ASSERT_EQ(size_t(5), result.diagnostics.size());
+    ASSERT_EQ(std::string("Expected variable name after 'let'"), result.diagnostics[0].message);
+    ASSERT_EQ(size_t(1), result.diagnostics[0].token);
+    ASSERT_EQ(std::string("Unexpected token: PUNCTUATION ';'"), result.diagnostics[1].message);
+    ASSERT_EQ(std::string("Expected PUNCTUATION ';' but got PUNCTUATION '}'"), result.diagnostics[2].message);
+    ASSERT_EQ(std::string("Unexpected token: PUNCTUATION '}'"), result.diagnostics[3].message);
+    ASSERT_EQ(std::string("Expected PUNCTUATION '}' but reached end of input"), result.diagnostics[4].message);
+    ASSERT_EQ(std::string(
+        "FunctionDecl(main)\n"
+        "  IfStatement\n"
+        "    Condition:\n"
+        "      Identifier(x)\n"
+        "    Then:\n"
+        "  LetDecl(y)\n"
+        "    NumberLiteral(2)\n"
+        "LetDecl(z)\n"
+        "  NumberLiteral(3)\n"), dump(result.ast));
+
+    // The flat builder drops the nodes of failed statements
+    auto flat = parser.parseFlat(tokens);
+    ASSERT_EQ(size_t(5), flat.diagnostics.size());
+    ASSERT_EQ(dump(result.ast), printFlatAst(flat.ast));
+    ASSERT_EQ(size_t(7), flat.ast.size());
+
+    // A clean parse reports nothing
+    ASSERT_EQ(true, parser.parse(lexer.tokenize(kProgram)).ok());
+}
+
+void test_interner_basic() {
+    Interner interner;
+    Symbol a = interner.intern("alpha");
+    Symbol b = interner.intern("beta");
+    Symbol a2 = interner.intern(std::string("alp") + "ha");
+    Symbol empty = interner.intern("");
+    ASSERT_EQ(true, a == a2);
+    ASSERT_EQ(true, a != b);
+    ASSERT_EQ(true, empty.valid());
+    ASSERT_EQ(std::string("alpha"), interner.lookup(a));
+    ASSERT_EQ(std::string("beta"), interner.lookup(b));
+    ASSERT_EQ(std::string(""), interner.lookup(empty));
+    ASSERT_EQ(3u, interner.size());
+
+    // Enough names to spill into several segments of every shard
+    std::vector<Symbol> symbols;
+    for (int i = 0; i < 100000; ++i) {
+        symbols.push_back(interner.intern("name" + std::to_string(i)));
+    }
+    for (int i = 0; i < 100000; i += 997) {
+        ASSERT_EQ("name" + std::to_string(i), interner.lookup(symbols[i]));
+    }
+    ASSERT_EQ(100003u, interner.size());
+}
+
+void test_interner_concurrent() {
+    // Threads interning overlapping names agree on every ID
+    Interner interner;
+    const int kThreads = 8;
+    const int kNames = 20000;
+    std::vector<std::vector<Symbol>> results(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; ++t) {
+        threads.emplace_back([&, t] {
+            results[t].resize(kNames);
+            for (int i = 0; i < kNames; ++i) {
+                int n = (i * 7 + t * 13) % kNames;
+                results[t][n] = interner.intern("id_" + std::to_string(n));
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    ASSERT_EQ(static_cast<size_t>(kNames), interner.size());
+    for (int t = 1; t < kThreads; ++t) {
+        for (int i = 0; i < kNames; i += 101) {
+            ASSERT_EQ(results[0][i].id, results[t][i].id);
+        }
+    }
+    for (int i = 0; i < kNames; i += 101) {
+        ASSERT_EQ("id_" + std::to_string(i), interner.lookup(results[kThreads - 1][i]));
+    }
+}
+
+void test_token_symbols() {
+    Lexer lexer;
+    std::string source = "let x = x + 42; fn y() {} \"x\"";
+    auto tokens = lexer.tokenize(source);
+    ASSERT_EQ(TokenType::IDENTIFIER, tokens[1].type);
+    ASSERT_EQ(TokenType::IDENTIFIER, tokens[3].type);
+    ASSERT_EQ(tokens[1].symbol.id, tokens[3].symbol.id);
+    ASSERT_EQ(std::string("x"), tokens[1].symbol.str());
+    // Literals are not interned: their text views the source
+    ASSERT_EQ(std::string("42"), tokens[5].value);
+    ASSERT_EQ(false, tokens[5].symbol.valid());
+    ASSERT_EQ(true, tokens[5].value.data() == source.data() + 12);
+    ASSERT_EQ(TokenType::STRING, tokens[13].type);
+    ASSERT_EQ(false, tokens[13].symbol.valid());
+    // Keywords and punctuation are not interned
+    ASSERT_EQ(false, tokens[0].symbol.valid());
+    ASSERT_EQ(std::string("let"), tokens[0].value);
+
+    // A Scope sends the names to a table of its own, which can be cleared
+    // and reused for the next file
+    Interner names;
+    {
+        Interner::Scope scope(names);
+        auto scoped = lexer.tokenize(source);
+        ASSERT_EQ(2u, names.size());
+        ASSERT_EQ(std::string("y"), scoped[8].symbol.str());
+        names.clear();
+        ASSERT_EQ(0u, names.size());
+        scoped = lexer.tokenize("let z = 1;");
+        ASSERT_EQ(std::string("z"), scoped[1].symbol.str());
+        ASSERT_EQ(1u, names.size());
+    }
+    ASSERT_EQ(std::string("x"), tokens[1].symbol.str());
+}
+
+static std::string describeMap(const SyntaxMap& map) {
+    std::ostringstream out;
+    for (size_t i = 0; i < map.items.size(); ++i) {
+        const SyntaxMap::Item& item = map.items[i];
+        out << "item@" << map.start(i) << ":";
+        for (const SyntaxMap::Block& b : item.blocks) {
+            out << " [" << b.open << "," << b.close << " p" << b.parent << " s" << b.slot << " o"
+                << static_cast<int>(b.owner) << "]";
+        }
+        out << "\n";
+    }
+    return out.str();
+}
+
+// Every map block's node must be the statement actually found at its slot
+static bool mapMatchesTree(const Program& program, const SyntaxMap& map) {
+    if (map.items.size() != program.size()) return false;
+    for (size_t i = 0; i < map.items.size(); ++i) {
+        const auto& blocks = map.items[i].blocks;
+        for (const SyntaxMap::Block& b : blocks) {
+            const ASTNode* expected = nullptr;
+            if (b.parent == SyntaxMap::kNone) {
+                expected = program.items[i];
+            } else {
+                const SyntaxMap::Block& p = blocks[b.parent];
+                const NodeList* list = nullptr;
+                switch (p.owner) {
+                    case SyntaxMap::Owner::Function: list = &static_cast<FunctionDecl*>(p.node)->body; break;
+                    case SyntaxMap::Owner::Then: list = &static_cast<IfStatement*>(p.node)->thenBody; break;
+                    case SyntaxMap::Owner::Else: list = &static_cast<IfStatement*>(p.node)->elseBody; break;
+                    case SyntaxMap::Owner::While: list = &static_cast<WhileStatement*>(p.node)->body; break;
+                }
+                expected = (*list)[b.slot];
+            }
+            if (b.node != expected) return false;
+        }
+    }
+    return true;
+}
+
+void test_reparse() {
+    uint32_t seed = 99;
+    auto next = [&](uint32_t bound) {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 8) % bound;
+    };
+
+    // Random nested programs
+    std::function<std::string(int)> statement = [&](int depth) -> std::string {
+        switch (next(depth > 2 ? 3 : 6)) {
+            case 0:  return "let a = b + 1;";
+            case 1:  return "return c;";
+            case 2:  return "x";
+            case 3:  return "while d { " + statement(depth + 1) + " " + statement(depth + 1) + " }";
+            case 4:  return "if e { " + statement(depth + 1) + " } else { " + statement(depth + 1) + " }";
+            default: return "if f { " + statement(depth + 1) + " }";
+        }
+    };
+    const char* snippets[] = {"", "y", "2", "+", ";", "{", "}", "let q = 3;", "if g { }", "else { }",
+                              "while h { let r = 4; }", "fn k() { x }", "return s;"};
+
+    Lexer lexer;
+    Parser parser;
+    for (int n = 0; n < 40; ++n) {
+        std::string text;
+        for (int f = 0; f < 6; ++f) {
+            text += "fn f" + std::to_string(f) + "() { " + statement(0) + " " + statement(0) + " }\n";
+            if (next(2)) text += "let t = 5;\n";
+        }
+        std::vector<Token> tokens = lexer.tokenize(text);
+        SyntaxMap map;
+        auto result = parser.parse(tokens, map);
+        ASSERT_EQ(true, result.ok());
+
+        // A chain of edits on the same tree and map
+        for (int e = 0; e < 30; ++e) {
+            // Half the edits keep the program valid (a renamed operand, or a
+            // statement added after a `;` or brace); the rest are anything
+            TokenEdit edit;
+            edit.first = next(static_cast<uint32_t>(tokens.size() + 1));
+            edit.oldCount = std::min<size_t>(next(3), tokens.size() - edit.first);
+            const char* snippet = snippets[next(sizeof(snippets) / sizeof(*snippets))];
+            uint32_t kind = next(4);
+            if (kind == 0 && edit.first < tokens.size() && tokens[edit.first].type == TokenType::IDENTIFIER) {
+                edit.oldCount = 1;
+                snippet = "y";
+            } else if (kind == 1 && edit.first > 0 &&
+                       (tokens[edit.first - 1].type == TokenType::SEMICOLON ||
+                        tokens[edit.first - 1].type == TokenType::LBRACE)) {
+                edit.oldCount = 0;
+                snippet = next(2) ? "let q = 3;" : "while h { let r = 4; }";
+            }
+            std::vector<Token> inserted = lexer.tokenize(snippet);
+            edit.newCount = inserted.size();
+            tokens.erase(tokens.begin() + edit.first, tokens.begin() + edit.first + edit.oldCount);
+            tokens.insert(tokens.begin() + edit.first, inserted.begin(), inserted.end());
+
+            result = parser.reparse(std::move(result), map, tokens, edit);
+            SyntaxMap fullMap;
+            auto full = parser.parse(tokens, fullMap);
+            ASSERT_EQ(dump(full.ast), dump(result.ast));
+            ASSERT_EQ(full.diagnostics.size(), result.diagnostics.size());
+            if (full.ok()) {
+                ASSERT_EQ(describeMap(fullMap), describeMap(map));
+                ASSERT_EQ(true, mapMatchesTree(result.ast, map));
+            } else {
+                // Start over from the valid program so later edits can take
+                // the incremental paths again
+                tokens = lexer.tokenize(text);
+                result = parser.parse(tokens, map);
+            }
+        }
+    }
+
+    // An edit inside one function body reuses every other function
+    std::vector<Token> tokens = lexer.tokenize("fn a() { let x = 1; } fn b() { while y { let z = 2; } }");
+    SyntaxMap map;
+    auto result = parser.parse(tokens, map);
+    const ASTNode* first = result.ast.items[0];
+    const ASTNode* loop = static_cast<const FunctionDecl*>(result.ast.items[1])->body[0];
+    std::vector<Token> inserted = lexer.tokenize("let w = 3;");
+    tokens.insert(tokens.begin() + 24, inserted.begin(), inserted.end());
+    result = parser.reparse(std::move(result), map, tokens, TokenEdit{24, 0, inserted.size()});
+    ASSERT_EQ(true, result.ast.items[0] == first);
+    ASSERT_EQ(false, static_cast<const FunctionDecl*>(result.ast.items[1])->body[0] == loop);
+    ASSERT_EQ(std::string("WhileStatement\n"
+                          "  Condition:\n"
+                          "    Identifier(y)\n"
+                          "  Body:\n"
+                          "    LetDecl(z)\n"
+                          "      NumberLiteral(2)\n"
+                          "    LetDecl(w)\n"
+                          "      NumberLiteral(3)"),
+              static_cast<const FunctionDecl*>(result.ast.items[1])->body[0]->toString());
+
+    // Replaced nodes pile up in the arena only until they outweigh the tree
+    const size_t name = 25;   // the `w` of `let w = 3;`
+    for (int e = 0; e < 2000; ++e) {
+        result = parser.reparse(std::move(result), map, tokens, TokenEdit{name, 1, 1});
+        ASSERT_EQ(true, result.ast.arena.bytesUsed() <= 3 * map.liveBytes);
+    }
+}
+
+static std::string printImage(const AstImage& image) {
+    OutputBuffer buffer;
+    {
+        AstWriter writer(buffer);
+        printFlatAst(image, writer);
+    }
+    return buffer.take();
+}
+
+void test_ast_image() {
+    std::string source = std::string(kProgram) + "fn empty() {}\nlet y = \"hi\";\n";
+    Lexer lexer;
+    auto tokens = lexer.tokenize(source);
+    Parser parser;
+    FlatAst flat = parser.parseFlat(tokens).ast;
+    std::string expected = printFlatAst(flat);
+
+    // std::string's buffer is heap memory and so suitably aligned, like a
+    // mapping would be
+    std::string bytes = writeAstImage(flat);
+    AstImage image;
+    std::string error;
+    ASSERT_EQ(true, image.open(bytes, &error));
+    ASSERT_EQ(flat.size(), image.size());
+    ASSERT_EQ(expected, printImage(image));
+    ASSERT_EQ(std::string("main"), image.text(image.roots()[0]));
+
+    auto rejects = [&](const std::string& damaged, const std::string& reason) {
+        std::string copy = damaged;
+        AstImage view;
+        ASSERT_EQ(false, view.open(copy, &error));
+        ASSERT_EQ(reason, error);
+    };
+    rejects(bytes.substr(0, 40), "truncated header");
+    rejects(bytes.substr(0, bytes.size() - 1), "truncated image");
+    rejects(bytes + "x", "size mismatch");
+    std::string damaged = bytes;
+    damaged[0] = 'X';
+    rejects(damaged, "not an AST image");
+    damaged = bytes;
+    damaged[4] = 2;
+    rejects(damaged, "unsupported version");
+    damaged = bytes;
+    damaged[bytes.size() - 1] ^= 1;
+    rejects(damaged, "checksum mismatch");
+
+    // Structural damage with a matching checksum is caught by the node checks
+    damaged = bytes;
+    AstImageHeader header;
+    std::memcpy(&header, damaged.data(), sizeof header);
+    damaged[sizeof header] = 42;  // kind of node 0
+    header.checksum = imageChecksum(damaged.data() + sizeof header, damaged.size() - sizeof header);
+    std::memcpy(&damaged[0], &header, sizeof header);
+    rejects(damaged, "bad node kind");
+
+    // An empty program is a valid image too
+    std::string empty = writeAstImage(parser.parseFlat(std::vector<Token>()).ast);
+    ASSERT_EQ(true, image.open(empty, &error));
+    ASSERT_EQ(std::string(), printImage(image));
+}
+
+// fn main() { if x { while x { if x { ... let y = 1 + 1 ...; } } else {} ... } }
+// with `depth` blocks alternating if/else and while, and `depth` operators
+static std::string nestedSource(size_t depth) {
+    std::string source = "fn main() {\n";
+    for (size_t i = 0; i < depth; ++i) source += i % 2 ? "while x {" : "if x {";
+    source += "let y = 1";
+    for (size_t i = 0; i < depth; ++i) source += " + 1";
+    source += ";";
+    for (size_t i = depth; i-- > 0;) source += i % 2 ? "}" : "} else {}";
+    return source + "\n}\n";
+}
+
+void test_deep_nesting() {
+    // A million nested blocks and a million-operator chain parse, and the
+    // results are torn down, without the native stack growing per level.
+    // The streaming lexer keeps the token vector out of the way.
+    const size_t kDepth = 1000000;
+    std::string source = nestedSource(kDepth);
+    Parser parser;
+    {
+        Lexer lexer(source);
+        auto result = parser.parse(lexer);
+        ASSERT_EQ(size_t(0), result.diagnostics.size());
+        ASSERT_EQ(size_t(1), result.ast.size());
+        const ASTNode* node = static_cast<const FunctionDecl*>(result.ast.items[0])->body[0];
+        size_t depth = 0;
+        for (;; ++depth) {
+            if (depth % 2 == 0) {
+                auto* stmt = dynamic_cast<const IfStatement*>(node);
+                if (!stmt || stmt->thenBody.size() != 1 || !stmt->elseBody.empty()) break;
+                node = stmt->thenBody[0];
+            } else {
+                auto* stmt = dynamic_cast<const WhileStatement*>(node);
+                if (!stmt || stmt->body.size() != 1) break;
+                node = stmt->body[0];
+            }
+        }
+        ASSERT_EQ(kDepth, depth);
+        auto* let = dynamic_cast<const LetDecl*>(node);
+        ASSERT_EQ(true, let != nullptr);
+        size_t operators = 0;
+        for (const ASTNode* value = let ? let->value : nullptr; auto* binary = dynamic_cast<const BinaryExpr*>(value);
+             value = binary->left) {
+            operators++;
+        }
+        ASSERT_EQ(kDepth, operators);
+    }
+    {
+        // fn, the statements, the let, the conditions, the numbers and the
+        // operators
+        Lexer lexer(source);
+        auto result = parser.parseFlat(lexer);
+        ASSERT_EQ(size_t(0), result.diagnostics.size());
+        ASSERT_EQ(size_t(4 * kDepth + 3), result.ast.size());
+        ASSERT_EQ(NodeKind::Function, result.ast.kinds.back());
+    }
+
+    // An unclosed block at that depth is reported once, at the end
+    {
+        std::string open = source.substr(0, source.find(';') + 1);
+        Lexer lexer(open);
+        auto result = parser.parse(lexer);
+        ASSERT_EQ(size_t(1), result.diagnostics.size());
+        ASSERT_EQ(size_t(0), result.ast.size());
+    }
+
+    // The printers use heap stacks as well. The output grows with the square
+    // of the depth (every level indents further), so a smaller tree is
+    // printed and checked against the flat printer.
+    std::string small = nestedSource(1000);
+    Lexer lexer;
+    auto tokens = lexer.tokenize(small);
+    std::string printed = dump(parser.parse(tokens).ast);
+    ASSERT_EQ(printFlatAst(parser.parseFlat(tokens).ast), printed);
+    // fn, four lines a level, the let, and the operators and numbers
+    ASSERT_EQ(size_t(1 + 4 * 1000 + 1 + 2 * 1000 + 1), size_t(std::count(printed.begin(), printed.end(), '\n')));
+}
+
+void test_run_stats() {
+    if (!kStatsEnabled) return;  // counting compiles to nothing
+
+    // The lexer counts what it hands out, EOF included, in either mode
+    RunStats stats;
+    stats.beginFile(std::strlen(kProgram));
+    Lexer lexer;
+    lexer.countTokens(stats.tokens);
+    auto tokens = lexer.tokenize(kProgram);
+    ASSERT_EQ(uint64_t(tokens.size() + 1), stats.tokenCount());
+    lexer.reset(kProgram);
+    Parser parser;
+    ASSERT_EQ(true, parser.parse(lexer).ok());
+    ASSERT_EQ(uint64_t(2 * (tokens.size() + 1)), stats.tokenCount());
+    ASSERT_EQ(uint64_t(16), stats.tokens[static_cast<size_t>(TokenType::IDENTIFIER)]);
+    lexer.countTokens(nullptr);
+
+    // Tree and flat node counts agree; fn, while and if nest three deep
+    auto tree = parser.parse(tokens);
+    ASSERT_EQ(3, parser.maxDepth());
+    stats.countNodes(tree.ast);
+    ASSERT_EQ(uint64_t(19), stats.nodeCount());
+    RunStats flat;
+    flat.countNodes(parser.parseFlat(tokens).ast);
+    for (size_t i = 0; i < RunStats::kNodeKinds; ++i) ASSERT_EQ(stats.nodes[i], flat.nodes[i]);
+    ASSERT_EQ(uint64_t(4), stats.nodes[static_cast<size_t>(NodeKind::Number)]);
+    stats.nested(parser.maxDepth());
+
+    flat.beginFile(5);
+    flat[Phase::Parse].wall = 0.25;
+    stats[Phase::Parse].wall = 0.5;
+    stats.merge(flat);
+    ASSERT_EQ(uint64_t(2), stats.files);
+    ASSERT_EQ(0.75, stats[Phase::Parse].wall);
+    ASSERT_EQ(uint64_t(38), stats.nodeCount());
+    ASSERT_EQ(3u, stats.maxDepth);
+
+    std::ostringstream json;
+    stats.writeJson(json);
+    ASSERT_EQ(size_t(0), json.str().find("{\"files\":2,\"bytes\":"));
+    ASSERT_EQ(true, json.str().find("\"nodes\":{\"total\":38,") != std::string::npos);
+    ASSERT_EQ(true, json.str().find("\"max_depth\":3}\n") != std::string::npos);
+    std::ostringstream text;
+    stats.writeText(text);
+    ASSERT_EQ(size_t(0), text.str().find("--- stats ---\n"));
+}
+
+void test_trace() {
+    if (!kStatsEnabled) return;  // the tracer compiles to nothing
+
+    // Nothing is recorded before start()
+    Parser parser;
+    Lexer lexer;
+    auto tokens = lexer.tokenize(kProgram);
+    parser.parse(tokens);
+    Tracer::start("rustparser");
+
+    // A span per top-level function, named after it, in either mode
+    parser.parse(tokens);
+    lexer.reset(kProgram);
+    parser.parseFlat(lexer);
+    // Another thread records into a buffer of its own
+    std::thread([] { TraceSpan span("file", "a \"b\"\\c\n"); }).join();
+
+    std::ostringstream out;
+    Tracer::write(out);
+    std::string json = out.str();
+    auto count = [&](const std::string& text) {
+        size_t n = 0;
+        for (size_t at = json.find(text); at != std::string::npos; at = json.find(text, at + 1)) n++;
+        return n;
+    };
+    ASSERT_EQ(size_t(0), json.find("{\"traceEvents\":[\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,"
+                                   "\"args\":{\"name\":\"main\"}}"));
+    ASSERT_EQ(size_t(2), count("{\"name\":\"fn\",\"cat\":\"rustparser\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":"));
+    ASSERT_EQ(size_t(2), count("\"args\":{\"detail\":\"main\"}"));
+    ASSERT_EQ(size_t(1), count("\"tid\":2,\"args\":{\"name\":\"thread 2\"}"));
+    ASSERT_EQ(size_t(1), count("\"args\":{\"detail\":\"a \\\"b\\\"\\\\c\\u000a\"}"));
+    std::string end = "\n],\"displayTimeUnit\":\"ms\"}\n";
+    ASSERT_EQ(json.size() - end.size(), json.rfind(end));
+}
+
+void test_alloc_stats() {
+    if (!kAllocStatsEnabled) return;  // operator new is the library's
+
+    // The tree's arena chunks count towards the parse, and nothing is
+    // counted towards a phase after its timer ends
+    const size_t parse = static_cast<size_t>(Phase::Parse);
+    Lexer lexer;
+    auto tokens = lexer.tokenize(kProgram);
+    RunStats stats;
+    Parser parser;
+    uint64_t before = allocReport(RunStats::kPhases)[parse].count;
+    ParseResult<Program> result;
+    {
+        PhaseTimer timer(&stats, Phase::Parse);
+        result = parser.parse(tokens);
+    }
+    std::vector<PhaseAllocs> report = allocReport(RunStats::kPhases);
+    ASSERT_EQ(RunStats::kPhases + 1, report.size());
+    ASSERT_EQ(true, report[parse].count > before);
+    ASSERT_EQ(true, report[parse].bytes >= result.ast.arena.bytesReserved());
+    ASSERT_EQ(true, report[parse].peakLive >= result.ast.arena.bytesReserved());
+    ASSERT_EQ(false, report[parse].sites.empty());
+    parser.parse(tokens);
+    ASSERT_EQ(report[parse].count, allocReport(RunStats::kPhases)[parse].count);
+
+    std::ostringstream json;
+    stats.writeJson(json);
+    ASSERT_EQ(true, json.str().find("\"allocations\":{\"read\":{\"count\":") != std::string::npos);
+    ASSERT_EQ(true, json.str().find("\"parse\":{\"count\":") != std::string::npos);
+    std::ostringstream text;
+    stats.writeText(text);
+    ASSERT_EQ(true, text.str().find("top sites, parse\n") != std::string::npos);
+}
+
+// ---- Test runner ----
+
+struct TestEntry {
+    const char* name;
+    void (*func)();
+};
+
+static TestEntry all_tests[] = {
+    {"parse_program",       test_parse_program},
+    {"parse_stream",        test_parse_stream},
+    {"parse_errors",        test_parse_errors},
+    {"output_buffer",       test_output_buffer},
+    {"flat_ast",            test_flat_ast},
+    {"flat_post_order",     test_flat_post_order},
+    {"interner_basic",      test_interner_basic},
+    {"interner_concurrent", test_interner_concurrent},
+    {"token_symbols",       test_token_symbols},
+    {"reparse",             test_reparse},
+    {"ast_image",           test_ast_image},
+    {"deep_nesting",        test_deep_nesting},
+    {"run_stats",           test_run_stats},
+    {"trace",               test_trace},
+    {"alloc_stats",         test_alloc_stats},
+};
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        std::cerr << "Usage: test_parser <test_name>" << std::endl;
+        std::cerr << "Available tests:" << std::endl;
+        for (auto& t : all_tests) {
+            std::cerr << "  " << t.name << std::endl;
+        }
+        return 1;
+    }
+
+    const char* target = argv[1];
+    for (auto& t : all_tests) {
+        if (std::strcmp(t.name, target) == 0) {
+            test_failures = 0;
+            test_assertions = 0;
+            t.func();
+            if (test_failures == 0) {
+                std::cout << "PASS: " << t.name << " (" << test_assertions << " assertions)" << std::endl;
+                return 0;
+            } else {
+                std::cerr << "FAIL: " << t.name << " (" << test_failures << " failures out of "
+                          << test_assertions << " assertions)" << std::endl;
+                return 1;
+            }
+        }
+    }
+
+    std::cerr << "Unknown test: " << target << std::endl;
+    return 1;
+}
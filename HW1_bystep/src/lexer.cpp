@@ -1,4 +1,5 @@
 #include "lexer.h"
+#include "common/keywords.h"
 
 std::vector<Token> Lexer::tokenize(const std::string& source) {
     std::vector<Token> tokens;
@@ -29,9 +30,7 @@ std::vector<Token> Lexer::tokenize(const std::string& source) {
             }
 
             // Check if it's a keyword
-            if (word == "fn" || word == "let" || word == "mut" ||
-                word == "if" || word == "else" || word == "while" ||
-                word == "return") {
+            if (classifyKeyword(word) != Keyword::None) {
                 tokens.push_back({"KEYWORD", word});
             } else {
                 tokens.push_back({"IDENTIFIER", word});
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Heap profiling behind `--stats`. FRONTEND_ALLOC_STATS=1 replaces the global
+// operator new and delete to count heap allocations per phase; see
+// alloc_stats.cpp. Each project sets it from its own CMake option
+// (LEXER_ALLOC_STATS, PARSER_ALLOC_STATS), off by default, and only together
+// with its --stats instrumentation.
+#ifndef FRONTEND_ALLOC_STATS
+#define FRONTEND_ALLOC_STATS 0
+#endif
+
+constexpr bool kAllocStatsEnabled = FRONTEND_ALLOC_STATS != 0;
+
+// Phases are numbered by each tool's Phase enum; allocations are kept apart
+// for this many
+constexpr size_t kMaxPhases = 4;
+
+// The phase whose PhaseTimer is running on this thread, which its heap
+// allocations are counted towards; kNoPhase outside of one. Only kept with
+// kAllocStatsEnabled.
+constexpr uint8_t kNoPhase = 0xff;
+extern thread_local uint8_t allocPhase;
+
+// Heap allocations made during one phase: how many, the bytes asked for,
+// the most bytes live at once (across all threads) while it ran, and the
+// call sites that asked for the most bytes
+struct AllocSite {
+    std::string name;             // "function+0x1f", or "file+0x1f4c"
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+struct PhaseAllocs {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+    uint64_t peakLive = 0;
+    std::vector<AllocSite> sites;
+};
+
+// The counts so far: one entry for each of the first `phases` phases, then
+// one for allocations outside of any. Empty without kAllocStatsEnabled.
+std::vector<PhaseAllocs> allocReport(size_t phases);
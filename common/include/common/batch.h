@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Runs a fixed batch of independent tasks on a set of worker threads. Each
+// worker owns a deque of task indices, seeded round-robin from the order the
+// caller asks for; it takes work from the front of its own deque and, once
+// that is empty, steals from the back of the others. Tasks are identified
+// by index, and the worker number passed alongside lets callers keep one set
+// of scratch buffers per worker.
+class WorkStealingPool {
+public:
+    using Task = std::function<void(size_t index, unsigned worker)>;
+
+    // `threads` == 0 means one per hardware thread
+    explicit WorkStealingPool(unsigned threads = 0);
+
+    unsigned size() const { return threads_; }
+
+    // Runs `task` once for every index in `order` and returns when all are
+    // done. Tasks are started roughly in `order`. With a single worker
+    // everything runs on the calling thread. The first exception thrown by a
+    // task is rethrown here after the other workers have stopped.
+    void run(const std::vector<size_t>& order, const Task& task);
+
+private:
+    unsigned threads_;
+};
+
+// Collects per-task output produced in any order and writes it in index
+// order as soon as every earlier task has finished, so the combined output
+// does not depend on scheduling and finished text is not held longer than
+// needed.
+class OrderedWriter {
+public:
+    OrderedWriter(size_t count, std::ostream& out, std::ostream& err);
+
+    // Hands over the stdout and stderr text of task `index`
+    void publish(size_t index, std::string out, std::string err);
+
+private:
+    struct Slot {
+        std::string out;
+        std::string err;
+        bool ready = false;
+    };
+
+    std::mutex mutex_;
+    std::vector<Slot> slots_;
+    size_t next_ = 0;
+    std::ostream& out_;
+    std::ostream& err_;
+};
+
+// Most worker threads a --jobs=N may ask for
+constexpr unsigned kMaxJobs = 1024;
+
+// The N of --jobs=N: decimal digits only, at most kMaxJobs, and 0 for one
+// thread per hardware thread. Returns false for anything else.
+bool parseJobs(const char* text, unsigned& jobs);
+
+// Paths listed one per line in `listPath` ("-" for stdin), skipping blank
+// lines. Returns false if the list cannot be read.
+bool readPathList(const std::string& listPath, std::vector<std::string>& paths);
+
+// Order in which to process `paths` on `workers` threads: by file size,
+// largest first, so that long tasks start early and do not end up as the
+// tail of the batch (ties and unreadable paths keep their input order). A
+// single worker keeps the input order, which lets OrderedWriter pass each
+// result straight through instead of holding it back.
+std::vector<size_t> batchOrder(const std::vector<std::string>& paths, unsigned workers);
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+// Packs up to eight bytes of a word into one integer, first byte lowest, so a
+// keyword check is a single integer compare. Usable at compile time to build
+// the keyword constants below.
+constexpr uint64_t packWord(const char* p, size_t n) {
+    uint64_t v = 0;
+    for (size_t i = 0; i < n; ++i) {
+        v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (8 * i);
+    }
+    return v;
+}
+
+constexpr uint64_t packWord(std::string_view word) {
+    return packWord(word.data(), word.size());
+}
+
+// The keywords of the Rust subset, in the order of each tool's KW_* token
+// types
+enum class Keyword : uint8_t { Fn, Let, Mut, If, Else, While, Return, None };
+
+// Classifies an identifier-shaped word as one of the keywords, or None.
+// Keyword lengths (2..6) are a perfect hash onto at most two candidates, and
+// each candidate is confirmed with one packed compare. Nothing is hashed or
+// allocated.
+inline Keyword classifyKeyword(std::string_view word) {
+    const char* p = word.data();
+    switch (word.size()) {
+        case 2: {
+            uint64_t w = packWord(p, 2);
+            if (w == packWord("fn")) return Keyword::Fn;
+            if (w == packWord("if")) return Keyword::If;
+            break;
+        }
+        case 3: {
+            uint64_t w = packWord(p, 3);
+            if (w == packWord("let")) return Keyword::Let;
+            if (w == packWord("mut")) return Keyword::Mut;
+            break;
+        }
+        case 4:
+            if (packWord(p, 4) == packWord("else")) return Keyword::Else;
+            break;
+        case 5:
+            if (packWord(p, 5) == packWord("while")) return Keyword::While;
+            break;
+        case 6:
+            if (packWord(p, 6) == packWord("return")) return Keyword::Return;
+            break;
+    }
+    return Keyword::None;
+}
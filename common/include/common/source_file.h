@@ -0,0 +1,35 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+
+// Read-only view of an input file. Regular files are memory-mapped with a
+// sequential-access hint; pipes, character devices and stdin ("-") fall back
+// to a single bulk read into an owned buffer. Either way the contents are
+// exposed as one contiguous view that stays valid until the SourceFile is
+// destroyed, so it can be handed straight to a lexer.
+class SourceFile {
+public:
+    SourceFile() = default;
+    ~SourceFile();
+
+    SourceFile(const SourceFile&) = delete;
+    SourceFile& operator=(const SourceFile&) = delete;
+    SourceFile(SourceFile&& other) noexcept;
+    SourceFile& operator=(SourceFile&& other) noexcept;
+
+    // Loads `path`, or stdin when `path` is "-". Returns false on failure.
+    bool open(const std::string& path);
+
+    std::string_view view() const { return {data_, size_}; }
+    bool isMapped() const { return mapped_; }
+
+private:
+    const char* data_ = "";
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::string buffer_;   // owns the bytes when the input is not mapped
+
+    void release();
+    bool readAll(int fd, size_t sizeHint);
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include "common/alloc_stats.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <initializer_list>
+#include <ostream>
+#include <string>
+
+// Per-phase timing and the report behind `--stats`. Each tool numbers its
+// phases with a Phase enum of its own and extends PhaseStats with what it
+// counts. The instrumentation is built only with FRONTEND_STATS=1, which
+// each project sets from its own CMake option (LEXER_STATS, PARSER_STATS,
+// on by default); otherwise PhaseTimer and the counting calls compile to
+// nothing and the CLIs reject --stats.
+#ifndef FRONTEND_STATS
+#define FRONTEND_STATS 0
+#endif
+
+constexpr bool kStatsEnabled = FRONTEND_STATS != 0;
+
+// Seconds spent in a phase, summed over every time it ran
+struct PhaseTime {
+    double wall = 0;
+    double cpu = 0;
+};
+
+// One table of a tool's counts in the report, e.g. tokens by type. Counts
+// of zero are left out.
+struct StatsCounts {
+    const char* title;
+    const uint64_t* counts;
+    size_t size;
+    std::string (*name)(size_t index);
+};
+
+// What every tool's RunStats holds: the time of each phase and of the whole
+// run, the sources read and the deepest nesting
+struct PhaseStats {
+    PhaseTime phases[kMaxPhases];
+    PhaseTime total;              // the whole run, CPU time of all threads
+    uint64_t files = 0;
+    uint64_t bytes = 0;           // source bytes read
+    uint32_t maxDepth = 0;        // deepest block nesting
+
+    template <class Phase>
+    PhaseTime& operator[](Phase phase) { return phases[static_cast<size_t>(phase)]; }
+    template <class Phase>
+    const PhaseTime& operator[](Phase phase) const { return phases[static_cast<size_t>(phase)]; }
+
+    void beginFile(size_t size) {
+        if constexpr (kStatsEnabled) {
+            files++;
+            bytes += size;
+        }
+    }
+
+protected:
+    void merge(const PhaseStats& other);
+
+    // The report: a table for people, or one JSON object on a single line.
+    // `phaseNames` names the tool's phases in enum order; `counts` follow
+    // the file totals. With kAllocStatsEnabled both include the heap
+    // allocations of the run.
+    void writeText(std::ostream& out, const char* const* phaseNames, size_t phaseCount,
+                   std::initializer_list<StatsCounts> counts) const;
+    void writeJson(std::ostream& out, const char* const* phaseNames, size_t phaseCount,
+                   std::initializer_list<StatsCounts> counts) const;
+};
+
+// Adds the wall and CPU time from construction to destruction to a
+// PhaseTime; does nothing for a null one. CPU time is the calling thread's,
+// or the whole process's with `process`. A timer for a phase of a RunStats
+// also sets allocPhase while it runs.
+class PhaseTimer {
+public:
+    explicit PhaseTimer(PhaseTime* into, bool process = false) {
+        if constexpr (kStatsEnabled) {
+            into_ = into;
+            if (!into_) return;
+            clock_ = process ? CLOCK_PROCESS_CPUTIME_ID : CLOCK_THREAD_CPUTIME_ID;
+            wall_ = std::chrono::steady_clock::now();
+            cpu_ = cpuSeconds(clock_);
+        }
+    }
+    template <class Phase>
+    PhaseTimer(PhaseStats* stats, Phase phase) : PhaseTimer(stats ? &(*stats)[phase] : nullptr) {
+        if constexpr (kAllocStatsEnabled) {
+            if (!stats) return;
+            previousPhase_ = allocPhase;
+            allocPhase = static_cast<uint8_t>(phase);
+            restorePhase_ = true;
+        }
+    }
+    ~PhaseTimer() {
+        if constexpr (kAllocStatsEnabled) {
+            if (restorePhase_) allocPhase = previousPhase_;
+        }
+        if constexpr (kStatsEnabled) {
+            if (!into_) return;
+            into_->wall += std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_).count();
+            into_->cpu += cpuSeconds(clock_) - cpu_;
+        }
+    }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    PhaseTime* into_ = nullptr;
+    clockid_t clock_ = CLOCK_THREAD_CPUTIME_ID;
+    std::chrono::steady_clock::time_point wall_;
+    double cpu_ = 0;
+    uint8_t previousPhase_ = kNoPhase;
+    bool restorePhase_ = false;
+
+    static double cpuSeconds(clockid_t clock) {
+        timespec ts{};
+        clock_gettime(clock, &ts);
+        return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+    }
+};
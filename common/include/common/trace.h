@@ -0,0 +1,66 @@
+#pragma once
+
+#include "common/stats.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// Timeline of one run behind `--trace=FILE`, written as Chrome trace-event
+// JSON (chrome://tracing, ui.perfetto.dev). Every thread records complete
+// events into a buffer of its own, so recording takes no lock; the buffers
+// are kept until the end of the run and written out together. Built with
+// the FRONTEND_STATS instrumentation and inert until start().
+class Tracer {
+public:
+    // Starts recording. The calling thread is shown as "main". `category`
+    // (a string literal, the tool's name) is the "cat" of every event.
+    static void start(const char* category);
+    static bool enabled() {
+        if constexpr (kStatsEnabled) return enabled_.load(std::memory_order_relaxed);
+        return false;
+    }
+
+    // Nanoseconds on the steady clock
+    static uint64_t now() {
+        return static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch())
+                .count());
+    }
+
+    // Records `name` (a string literal) as running from `begin` to `end` on
+    // the calling thread. `detail`, e.g. a path, is copied.
+    static void record(const char* name, std::string_view detail, uint64_t begin, uint64_t end);
+
+    // Writes the events of every thread. The threads that recorded them must
+    // have finished or be idle.
+    static void write(std::ostream& out);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records the time from construction to destruction as one event, if
+// tracing is on
+class TraceSpan {
+public:
+    explicit TraceSpan(const char* name, std::string_view detail = {}) {
+        if (Tracer::enabled()) {
+            name_ = name;
+            detail_ = detail;
+            begin_ = Tracer::now();
+        }
+    }
+    ~TraceSpan() {
+        if (name_) Tracer::record(name_, detail_, begin_, Tracer::now());
+    }
+
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+    const char* name_ = nullptr;
+    std::string_view detail_;
+    uint64_t begin_ = 0;
+};
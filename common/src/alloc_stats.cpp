@@ -0,0 +1,198 @@
+#include "common/alloc_stats.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <cxxabi.h>
+#include <dlfcn.h>
+#include <malloc.h>
+
+// Heap profiling behind `--stats` in a FRONTEND_ALLOC_STATS build. The global
+// operator new and delete below count every allocation towards the phase
+// its thread is in, and towards the code that called them. They take
+// no locks and never allocate themselves: the counters and the site tables
+// are fixed arrays of atomics.
+
+thread_local uint8_t allocPhase = kNoPhase;
+
+namespace {
+
+// One slot per phase, and a last one for allocations outside of any
+constexpr size_t kSlots = kMaxPhases + 1;
+
+// Distinct call sites kept per slot. A site that finds no room is still
+// counted in its slot's totals.
+constexpr unsigned kSiteBits = 10;
+constexpr size_t kSites = size_t(1) << kSiteBits;
+constexpr size_t kProbes = 16;
+constexpr size_t kTopSites = 5;
+
+struct Counters {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> peakLive;
+};
+
+struct Site {
+    std::atomic<uintptr_t> address;  // 0 while free
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> bytes;
+};
+
+Counters counters[kSlots];
+Site sites[kSlots][kSites];
+std::atomic<uint64_t> live;  // usable bytes of the blocks not yet freed
+
+constexpr auto relaxed = std::memory_order_relaxed;
+
+void countSite(Site* table, uintptr_t address, size_t size) {
+    size_t hash = static_cast<size_t>((address * 0x9E3779B97F4A7C15ull) >> (64 - kSiteBits));
+    for (size_t probe = 0; probe < kProbes; ++probe) {
+        Site& site = table[(hash + probe) % kSites];
+        uintptr_t key = site.address.load(relaxed);
+        if (key == 0 && site.address.compare_exchange_strong(key, address, relaxed)) key = address;
+        if (key == address) {
+            site.count.fetch_add(1, relaxed);
+            site.bytes.fetch_add(size, relaxed);
+            return;
+        }
+    }
+}
+
+[[maybe_unused]] void* allocate(size_t size, void* caller) noexcept {
+    void* block = std::malloc(size ? size : 1);
+    if (!block) return nullptr;
+    size_t slot = allocPhase < kMaxPhases ? allocPhase : kMaxPhases;
+    Counters& c = counters[slot];
+    c.count.fetch_add(1, relaxed);
+    c.bytes.fetch_add(size, relaxed);
+    size_t usable = malloc_usable_size(block);
+    uint64_t now = live.fetch_add(usable, relaxed) + usable;
+    uint64_t peak = c.peakLive.load(relaxed);
+    while (now > peak && !c.peakLive.compare_exchange_weak(peak, now, relaxed)) {
+    }
+    countSite(sites[slot], reinterpret_cast<uintptr_t>(caller), size);
+    return block;
+}
+
+[[maybe_unused]] void release(void* block) noexcept {
+    if (!block) return;
+    live.fetch_sub(malloc_usable_size(block), relaxed);
+    std::free(block);
+}
+
+// "function+0x1f" for a return address. Without a symbol (executables need
+// ENABLE_EXPORTS to have theirs found, and static functions never are) it
+// is "file+0x1f4c", for addr2line.
+std::string siteName(uintptr_t address) {
+    char offset[32];
+    Dl_info info;
+    if (!dladdr(reinterpret_cast<void*>(address), &info)) {
+        std::snprintf(offset, sizeof offset, "0x%zx", static_cast<size_t>(address));
+        return offset;
+    }
+    if (!info.dli_sname) {
+        std::string file = info.dli_fname ? info.dli_fname : "";
+        std::snprintf(offset, sizeof offset, "+0x%zx",
+                      static_cast<size_t>(address - reinterpret_cast<uintptr_t>(info.dli_fbase)));
+        return file.substr(file.rfind('/') + 1) + offset;
+    }
+    int status = 0;
+    char* demangled = abi::__cxa_demangle(info.dli_sname, nullptr, nullptr, &status);
+    std::string name = status == 0 && demangled ? demangled : info.dli_sname;
+    std::free(demangled);
+    std::snprintf(offset, sizeof offset, "+0x%zx",
+                  static_cast<size_t>(address - reinterpret_cast<uintptr_t>(info.dli_saddr)));
+    return name + offset;
+}
+
+} // namespace
+
+std::vector<PhaseAllocs> allocReport(size_t phases) {
+    std::vector<PhaseAllocs> report;
+    if constexpr (!kAllocStatsEnabled) return report;
+
+    // Read everything before this function allocates anything itself
+    struct Found {
+        uintptr_t address;
+        uint64_t count;
+        uint64_t bytes;
+    };
+    Found top[kSlots][kTopSites];
+    size_t found[kSlots] = {};
+    uint64_t totals[kSlots][3];
+    for (size_t slot = 0; slot < kSlots; ++slot) {
+        totals[slot][0] = counters[slot].count.load(relaxed);
+        totals[slot][1] = counters[slot].bytes.load(relaxed);
+        totals[slot][2] = counters[slot].peakLive.load(relaxed);
+        for (const Site& site : sites[slot]) {
+            uintptr_t address = site.address.load(relaxed);
+            if (address == 0) continue;
+            Found f{address, site.count.load(relaxed), site.bytes.load(relaxed)};
+            // Insert into the top list, which is sorted by bytes, largest first
+            size_t n = found[slot];
+            if (n == kTopSites && top[slot][n - 1].bytes >= f.bytes) continue;
+            if (n < kTopSites) found[slot] = ++n;
+            size_t at = n - 1;
+            while (at > 0 && top[slot][at - 1].bytes < f.bytes) {
+                top[slot][at] = top[slot][at - 1];
+                --at;
+            }
+            top[slot][at] = f;
+        }
+    }
+
+    phases = std::min(phases, kMaxPhases);
+    report.resize(phases + 1);
+    for (size_t entry = 0; entry <= phases; ++entry) {
+        size_t slot = entry < phases ? entry : kMaxPhases;
+        report[entry].count = totals[slot][0];
+        report[entry].bytes = totals[slot][1];
+        report[entry].peakLive = totals[slot][2];
+        for (size_t i = 0; i < found[slot]; ++i) {
+            report[entry].sites.push_back({siteName(top[slot][i].address), top[slot][i].count, top[slot][i].bytes});
+        }
+    }
+    return report;
+}
+
+#if FRONTEND_ALLOC_STATS
+// The library's nothrow deletes forward to these. The aligned forms are
+// left to the library, which pairs them with each other.
+void* operator new(size_t size) {
+    void* block = allocate(size, __builtin_return_address(0));
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new[](size_t size) {
+    void* block = allocate(size, __builtin_return_address(0));
+    if (!block) throw std::bad_alloc();
+    return block;
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, __builtin_return_address(0));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return allocate(size, __builtin_return_address(0));
+}
+
+void operator delete(void* block) noexcept {
+    release(block);
+}
+
+void operator delete[](void* block) noexcept {
+    release(block);
+}
+
+void operator delete(void* block, size_t) noexcept {
+    release(block);
+}
+
+void operator delete[](void* block, size_t) noexcept {
+    release(block);
+}
+#endif
@@ -0,0 +1,152 @@
+#include "common/batch.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sys/stat.h>
+#include <thread>
+#include <utility>
+
+WorkStealingPool::WorkStealingPool(unsigned threads) : threads_(threads) {
+    if (threads_ == 0) threads_ = std::thread::hardware_concurrency();
+    if (threads_ == 0) threads_ = 1;
+}
+
+void WorkStealingPool::run(const std::vector<size_t>& order, const Task& task) {
+    if (order.empty()) return;
+    unsigned workers = static_cast<unsigned>(std::min<size_t>(threads_, order.size()));
+    if (workers == 1) {
+        for (size_t index : order) task(index, 0);
+        return;
+    }
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> items;
+    };
+    std::unique_ptr<Queue[]> queues(new Queue[workers]);
+    for (size_t i = 0; i < order.size(); ++i) {
+        queues[i % workers].items.push_back(order[i]);
+    }
+
+    std::mutex errorMutex;
+    std::exception_ptr error;
+
+    // Own queue from the front, then everybody else's from the back. No task
+    // is added after the start, so finding every queue empty means done.
+    auto next = [&](unsigned self, size_t& index) {
+        for (unsigned k = 0; k < workers; ++k) {
+            Queue& q = queues[(self + k) % workers];
+            std::lock_guard<std::mutex> lock(q.mutex);
+            if (q.items.empty()) continue;
+            if (k == 0) {
+                index = q.items.front();
+                q.items.pop_front();
+            } else {
+                index = q.items.back();
+                q.items.pop_back();
+            }
+            return true;
+        }
+        return false;
+    };
+
+    auto work = [&](unsigned self) {
+        size_t index;
+        while (next(self, index)) {
+            try {
+                task(index, self);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(errorMutex);
+                if (!error) error = std::current_exception();
+                // Drain everything so the other workers stop too
+                for (unsigned k = 0; k < workers; ++k) {
+                    std::lock_guard<std::mutex> qlock(queues[k].mutex);
+                    queues[k].items.clear();
+                }
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    threads.reserve(workers - 1);
+    for (unsigned w = 1; w < workers; ++w) {
+        threads.emplace_back(work, w);
+    }
+    work(0);
+    for (auto& t : threads) t.join();
+
+    if (error) std::rethrow_exception(error);
+}
+
+OrderedWriter::OrderedWriter(size_t count, std::ostream& out, std::ostream& err)
+    : slots_(count), out_(out), err_(err) {}
+
+void OrderedWriter::publish(size_t index, std::string out, std::string err) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_[index].out = std::move(out);
+    slots_[index].err = std::move(err);
+    slots_[index].ready = true;
+    while (next_ < slots_.size() && slots_[next_].ready) {
+        Slot& slot = slots_[next_++];
+        out_.write(slot.out.data(), static_cast<std::streamsize>(slot.out.size()));
+        if (!slot.err.empty()) {
+            out_.flush();
+            err_.write(slot.err.data(), static_cast<std::streamsize>(slot.err.size()));
+        }
+        std::string().swap(slot.out);
+        std::string().swap(slot.err);
+    }
+    if (next_ == slots_.size()) out_.flush();
+}
+
+bool parseJobs(const char* text, unsigned& jobs) {
+    const char* end = text + std::strlen(text);
+    unsigned value = 0;
+    auto [ptr, ec] = std::from_chars(text, end, value);
+    if (ec != std::errc() || ptr != end || value > kMaxJobs) return false;
+    jobs = value;
+    return true;
+}
+
+bool readPathList(const std::string& listPath, std::vector<std::string>& paths) {
+    std::ifstream file;
+    std::istream* in = &std::cin;
+    if (listPath != "-") {
+        file.open(listPath);
+        if (!file) return false;
+        in = &file;
+    }
+    std::string line;
+    while (std::getline(*in, line)) {
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+        if (!line.empty()) paths.push_back(line);
+    }
+    return true;
+}
+
+std::vector<size_t> batchOrder(const std::vector<std::string>& paths, unsigned workers) {
+    std::vector<size_t> order;
+    order.reserve(paths.size());
+    if (workers <= 1) {
+        for (size_t i = 0; i < paths.size(); ++i) order.push_back(i);
+        return order;
+    }
+
+    std::vector<std::pair<off_t, size_t>> sized;
+    sized.reserve(paths.size());
+    for (size_t i = 0; i < paths.size(); ++i) {
+        struct stat st;
+        off_t size = (paths[i] != "-" && ::stat(paths[i].c_str(), &st) == 0) ? st.st_size : 0;
+        sized.emplace_back(size, i);
+    }
+    std::stable_sort(sized.begin(), sized.end(),
+                     [](const auto& a, const auto& b) { return a.first > b.first; });
+    for (const auto& entry : sized) order.push_back(entry.second);
+    return order;
+}
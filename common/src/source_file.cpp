@@ -0,0 +1,115 @@
+#include "common/source_file.h"
+
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+SourceFile::~SourceFile() {
+    release();
+}
+
+SourceFile::SourceFile(SourceFile&& other) noexcept {
+    *this = std::move(other);
+}
+
+SourceFile& SourceFile::operator=(SourceFile&& other) noexcept {
+    if (this == &other) return *this;
+    release();
+    mapped_ = other.mapped_;
+    size_ = other.size_;
+    buffer_ = std::move(other.buffer_);
+    data_ = mapped_ ? other.data_ : buffer_.data();
+    other.data_ = "";
+    other.size_ = 0;
+    other.mapped_ = false;
+    return *this;
+}
+
+void SourceFile::release() {
+    if (mapped_) {
+        munmap(const_cast<char*>(data_), size_);
+    }
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+    data_ = "";
+    size_ = 0;
+    mapped_ = false;
+}
+
+bool SourceFile::open(const std::string& path) {
+    release();
+
+    if (path == "-") {
+        return readAll(STDIN_FILENO, 0);
+    }
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || S_ISDIR(st.st_mode)) {
+        ::close(fd);
+        return false;
+    }
+
+    if (S_ISREG(st.st_mode) && st.st_size > 0) {
+        size_t size = static_cast<size_t>(st.st_size);
+        void* addr = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            posix_madvise(addr, size, POSIX_MADV_SEQUENTIAL);
+            ::close(fd);
+            data_ = static_cast<const char*>(addr);
+            size_ = size;
+            mapped_ = true;
+            return true;
+        }
+    }
+
+    // Pipes, devices, empty files and filesystems that refuse mmap
+    size_t hint = S_ISREG(st.st_mode) ? static_cast<size_t>(st.st_size) : 0;
+    bool ok = readAll(fd, hint);
+    ::close(fd);
+    return ok;
+}
+
+bool SourceFile::readAll(int fd, size_t sizeHint) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    // Read straight into the final buffer. With an exact size hint this is a
+    // single read; the buffer only grows for pipes or files that changed size.
+    buffer_.resize(sizeHint > 0 ? sizeHint : 64 * 1024);
+    size_t used = 0;
+    for (;;) {
+        if (used == buffer_.size()) {
+            // Probe for EOF before doubling so an exact hint never over-allocates
+            char probe[4096];
+            ssize_t n = ::read(fd, probe, sizeof(probe));
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0) {
+                buffer_.clear();
+                return false;
+            }
+            if (n == 0) break;
+            buffer_.resize(buffer_.size() * 2);
+            buffer_.replace(used, static_cast<size_t>(n), probe, static_cast<size_t>(n));
+            used += static_cast<size_t>(n);
+            continue;
+        }
+        ssize_t n = ::read(fd, &buffer_[used], buffer_.size() - used);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            buffer_.clear();
+            return false;
+        }
+        if (n == 0) break;
+        used += static_cast<size_t>(n);
+    }
+    buffer_.resize(used);
+    data_ = buffer_.data();
+    size_ = used;
+    return true;
+}
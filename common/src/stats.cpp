@@ -0,0 +1,142 @@
+#include "common/stats.h"
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace {
+
+// printf into a string, for the fixed-width columns
+template <class... Args>
+std::string format(const char* spec, Args... args) {
+    char buffer[128];
+    int n = std::snprintf(buffer, sizeof buffer, spec, args...);
+    return std::string(buffer, n < 0 ? 0 : std::min(static_cast<size_t>(n), sizeof buffer - 1));
+}
+
+uint64_t countTotal(const StatsCounts& counts) {
+    uint64_t n = 0;
+    for (size_t i = 0; i < counts.size; ++i) n += counts.counts[i];
+    return n;
+}
+
+// A quoted JSON string; site names are C++ signatures, so only quotes,
+// backslashes and control characters need escaping
+std::string jsonString(const std::string& text) {
+    std::string quoted = "\"";
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            quoted += format("\\u%04x", static_cast<unsigned>(c));
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + '"';
+}
+
+// Keeps long template signatures to one line of the table
+std::string shorten(const std::string& name) {
+    constexpr size_t kWidth = 100;
+    return name.size() <= kWidth ? name : name.substr(0, kWidth - 3) + "...";
+}
+
+// allocReport() has an entry per phase, then one for allocations outside
+// of any
+const char* allocName(const char* const* phaseNames, size_t phaseCount, size_t entry) {
+    return entry < phaseCount ? phaseNames[entry] : "other";
+}
+
+void writeAllocText(std::ostream& out, const char* const* phaseNames, size_t phaseCount) {
+    std::vector<PhaseAllocs> report = allocReport(phaseCount);
+    out << format("%-10s %12s %14s %14s\n", "allocs", "count", "bytes", "peak live");
+    for (size_t i = 0; i < report.size(); ++i) {
+        out << format("%-10s %12llu %14llu %14llu\n", allocName(phaseNames, phaseCount, i),
+                      static_cast<unsigned long long>(report[i].count),
+                      static_cast<unsigned long long>(report[i].bytes),
+                      static_cast<unsigned long long>(report[i].peakLive));
+    }
+    for (size_t i = 0; i < report.size(); ++i) {
+        if (report[i].sites.empty()) continue;
+        out << "top sites, " << allocName(phaseNames, phaseCount, i) << '\n';
+        for (const AllocSite& site : report[i].sites) {
+            out << format("  %10llu %14llu  ", static_cast<unsigned long long>(site.count),
+                          static_cast<unsigned long long>(site.bytes))
+                << shorten(site.name) << '\n';
+        }
+    }
+}
+
+void writeAllocJson(std::ostream& out, const char* const* phaseNames, size_t phaseCount) {
+    std::vector<PhaseAllocs> report = allocReport(phaseCount);
+    out << "\"allocations\":{";
+    for (size_t i = 0; i < report.size(); ++i) {
+        const PhaseAllocs& p = report[i];
+        out << (i ? ",\"" : "\"") << allocName(phaseNames, phaseCount, i) << "\":{\"count\":" << p.count
+            << ",\"bytes\":" << p.bytes << ",\"peak_live\":" << p.peakLive << ",\"sites\":[";
+        for (size_t j = 0; j < p.sites.size(); ++j) {
+            out << (j ? ",{\"site\":" : "{\"site\":") << jsonString(p.sites[j].name) << ",\"count\":"
+                << p.sites[j].count << ",\"bytes\":" << p.sites[j].bytes << '}';
+        }
+        out << "]}";
+    }
+    out << "},";
+}
+
+} // namespace
+
+void PhaseStats::merge(const PhaseStats& other) {
+    for (size_t i = 0; i < kMaxPhases; ++i) {
+        phases[i].wall += other.phases[i].wall;
+        phases[i].cpu += other.phases[i].cpu;
+    }
+    files += other.files;
+    bytes += other.bytes;
+    maxDepth = std::max(maxDepth, other.maxDepth);
+}
+
+void PhaseStats::writeText(std::ostream& out, const char* const* phaseNames, size_t phaseCount,
+                           std::initializer_list<StatsCounts> counts) const {
+    out << "--- stats ---\n" << format("%-10s %12s %12s\n", "phase", "wall ms", "cpu ms");
+    for (size_t i = 0; i < phaseCount; ++i) {
+        out << format("%-10s %12.3f %12.3f\n", phaseNames[i], phases[i].wall * 1e3, phases[i].cpu * 1e3);
+    }
+    out << format("%-10s %12.3f %12.3f\n", "total", total.wall * 1e3, total.cpu * 1e3);
+    double mbps = total.wall > 0 ? bytes / 1e6 / total.wall : 0;
+    out << "files " << files << ", " << bytes << " bytes, " << format("%.1f", mbps) << " MB/s\n";
+    for (const StatsCounts& c : counts) {
+        out << c.title << ' ' << countTotal(c) << '\n';
+        for (size_t i = 0; i < c.size; ++i) {
+            if (c.counts[i] == 0) continue;
+            out << format("  %-16s %12llu\n", c.name(i).c_str(), static_cast<unsigned long long>(c.counts[i]));
+        }
+    }
+    out << "max depth " << maxDepth << '\n';
+    if constexpr (kAllocStatsEnabled) writeAllocText(out, phaseNames, phaseCount);
+}
+
+void PhaseStats::writeJson(std::ostream& out, const char* const* phaseNames, size_t phaseCount,
+                           std::initializer_list<StatsCounts> counts) const {
+    auto time = [&](const char* name, const PhaseTime& t) {
+        out << '"' << name << "\":" << format("{\"wall_ms\":%.6g,\"cpu_ms\":%.6g}", t.wall * 1e3, t.cpu * 1e3);
+    };
+    out << "{\"files\":" << files << ",\"bytes\":" << bytes << ",\"phases\":{";
+    for (size_t i = 0; i < phaseCount; ++i) {
+        time(phaseNames[i], phases[i]);
+        out << ',';
+    }
+    time("total", total);
+    out << '}';
+    for (const StatsCounts& c : counts) {
+        out << ",\"" << c.title << "\":{\"total\":" << countTotal(c);
+        for (size_t i = 0; i < c.size; ++i) {
+            if (c.counts[i] != 0) out << ",\"" << c.name(i) << "\":" << c.counts[i];
+        }
+        out << '}';
+    }
+    out << ',';
+    if constexpr (kAllocStatsEnabled) writeAllocJson(out, phaseNames, phaseCount);
+    out << "\"max_depth\":" << maxDepth << "}\n";
+}
@@ -0,0 +1,135 @@
+#include "common/trace.h"
+#include <charconv>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::atomic<bool> Tracer::enabled_{false};
+
+namespace {
+
+struct Event {
+    const char* name;
+    uint32_t detail;      // offset of the detail in ThreadBuffer::text
+    uint32_t detailSize;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// Written only by the thread it belongs to, until write()
+struct ThreadBuffer {
+    uint32_t tid = 0;
+    std::vector<Event> events;
+    std::string text;
+};
+
+std::mutex registryMutex;
+std::vector<std::unique_ptr<ThreadBuffer>> registry;
+uint64_t origin = 0;
+const char* category = "";
+thread_local ThreadBuffer* local = nullptr;
+
+// The calling thread's buffer; the first call of a thread registers it,
+// which is the only time a lock is taken
+ThreadBuffer& localBuffer() {
+    if (!local) {
+        auto buffer = std::make_unique<ThreadBuffer>();
+        buffer->events.reserve(4096);
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer->tid = static_cast<uint32_t>(registry.size() + 1);
+        local = buffer.get();
+        registry.push_back(std::move(buffer));
+    }
+    return *local;
+}
+
+void appendString(std::string& out, std::string_view text) {
+    out += '"';
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            char escaped[8];
+            std::snprintf(escaped, sizeof escaped, "\\u%04x", static_cast<unsigned>(c));
+            out += escaped;
+        } else {
+            out += c;
+        }
+    }
+    out += '"';
+}
+
+void appendNumber(std::string& out, uint64_t value) {
+    char digits[24];
+    out.append(digits, std::to_chars(digits, digits + sizeof digits, value).ptr);
+}
+
+// Microseconds with three decimals, the unit of "ts" and "dur"
+void appendMicros(std::string& out, uint64_t nanos) {
+    appendNumber(out, nanos / 1000);
+    char fraction[4] = {'.', static_cast<char>('0' + nanos / 100 % 10), static_cast<char>('0' + nanos / 10 % 10),
+                        static_cast<char>('0' + nanos % 10)};
+    out.append(fraction, sizeof fraction);
+}
+
+} // namespace
+
+void Tracer::start(const char* name) {
+    if constexpr (kStatsEnabled) {
+        category = name;
+        origin = now();
+        localBuffer();
+        enabled_.store(true, std::memory_order_relaxed);
+    }
+}
+
+void Tracer::record(const char* name, std::string_view detail, uint64_t begin, uint64_t end) {
+    ThreadBuffer& buffer = localBuffer();
+    buffer.events.push_back({name, static_cast<uint32_t>(buffer.text.size()), static_cast<uint32_t>(detail.size()),
+                             begin, end});
+    buffer.text.append(detail.data(), detail.size());
+}
+
+void Tracer::write(std::ostream& out) {
+    std::lock_guard<std::mutex> lock(registryMutex);
+    // Formatted into blocks, as the event count easily reaches the hundreds
+    // of thousands
+    std::string text = "{\"traceEvents\":[";
+    bool first = true;
+    for (const auto& buffer : registry) {
+        text += first ? "\n" : ",\n";
+        text += "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":";
+        appendNumber(text, buffer->tid);
+        text += ",\"args\":{\"name\":";
+        appendString(text, buffer->tid == 1 ? "main" : "thread " + std::to_string(buffer->tid));
+        text += "}}";
+        first = false;
+        for (const Event& e : buffer->events) {
+            text += ",\n{\"name\":\"";
+            text += e.name;
+            text += "\",\"cat\":\"";
+            text += category;
+            text += "\",\"ph\":\"X\",\"pid\":1,\"tid\":";
+            appendNumber(text, buffer->tid);
+            text += ",\"ts\":";
+            appendMicros(text, e.begin - origin);
+            text += ",\"dur\":";
+            appendMicros(text, e.end - e.begin);
+            if (e.detailSize > 0) {
+                text += ",\"args\":{\"detail\":";
+                appendString(text, std::string_view(buffer->text).substr(e.detail, e.detailSize));
+                text += '}';
+            }
+            text += '}';
+            if (text.size() >= (1 << 20)) {
+                out.write(text.data(), static_cast<std::streamsize>(text.size()));
+                text.clear();
+            }
+        }
+    }
+    text += "\n],\"displayTimeUnit\":\"ms\"}\n";
+    out.write(text.data(), static_cast<std::streamsize>(text.size()));
+}